@@ -181,7 +181,8 @@ HEADERS += src/qt/bitcoingui.h \
     src/ui_interface.h \
     src/kernel.h \
     src/dcrypt.h \
-    src/sha256.h
+    src/sha256.h \
+    src/workqueue.h
 
 SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/transactiontablemodel.cpp \
@@ -241,7 +242,8 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/qtipcserver.cpp \
     src/kernel.cpp \
     src/dcrypt.cpp \
-    src/sha256.cpp
+    src/sha256.cpp \
+    src/workqueue.cpp
 
 RESOURCES += \
     src/qt/bitcoin.qrc
@@ -0,0 +1,232 @@
+// Copyright (c) 2013-2014 The heat developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//Hashing micro-benchmarks, built with: make -f makefile.unix bench_heat
+//
+// usage: bench_heat [-n=<ops>] [-dcryptlanes=<n>]
+//
+//Every run hashes the same data, headers are the mainnet genesis header with the
+// nonce counting up from 0, so numbers from different machines can be compared.
+
+#include <algorithm>
+#include <map>
+
+#include "main.h"
+#include "wallet.h"
+#include "dcrypt.h"
+
+CWallet* pwalletMain;
+
+void Shutdown(void* parg)
+{
+  exit(0);
+}
+
+void StartShutdown()
+{
+  exit(0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/*                            Allocation counting                           */
+//////////////////////////////////////////////////////////////////////////////
+
+static uint64 nAllocs = 0;
+
+#ifdef __GLIBC__
+//everything, including operator new, ends up in these, so counting here catches it all
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t nmemb, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+  nAllocs++;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size)
+{
+  nAllocs++;
+  return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  nAllocs++;
+  return __libc_realloc(ptr, size);
+}
+#define BENCH_COUNTS_ALLOCS true
+#else
+#define BENCH_COUNTS_ALLOCS false
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+/*                                Benchmarks                                */
+//////////////////////////////////////////////////////////////////////////////
+
+static CBlock benchBlock;
+static uint256 hashBench;
+
+//the mainnet genesis header, its dcrypt hash is checked before anything is timed
+static void SetupBenchBlock()
+{
+  benchBlock.nVersion       = 1;
+  benchBlock.hashPrevBlock  = 0;
+  benchBlock.hashMerkleRoot = uint256("0x0b0d42f6519b7d19f4ac4ad5fefddfdd1499add41a0ce0933f3d8a01cd79726e");
+  benchBlock.nTime          = 1418270653;
+  benchBlock.nBits          = CBigNum(~uint256(0) >> 20).GetCompact();
+  benchBlock.nNonce         = 908764;
+}
+
+static void BenchDcrypt(u32int i)
+{
+  benchBlock.nNonce = i;
+  hashBench = dcrypt(UBEGIN(benchBlock.nVersion), HASH_BLOCK_SIZE(benchBlock));
+}
+
+static void BenchDcryptMulti(u32int i)
+{
+  //one batch hashes a full round of nonces, like ScanDcryptHash does
+  static u8int headers[SHA256_MAX_LANES * 16][HASH_HEADER_SIZE];
+  static const u8int *pheaders[SHA256_MAX_LANES * 16];
+  static uint256 hashes[SHA256_MAX_LANES * 16];
+  const u32int nBatch = SHA256_MAX_LANES * 16;
+
+  for(u32int j = 0; j < nBatch; j++)
+  {
+    benchBlock.nNonce = i * nBatch + j;
+    memcpy(headers[j], UBEGIN(benchBlock.nVersion), HASH_HEADER_SIZE);
+    pheaders[j] = headers[j];
+  }
+
+  dcrypt_multi(pheaders, HASH_HEADER_SIZE, hashes, nBatch);
+  hashBench = hashes[nBatch - 1];
+}
+
+static void BenchSha256ToStr(u32int i)
+{
+  static u8int str[SHA256_LEN + 1], digest[SHA256_DIGEST_LENGTH];
+
+  benchBlock.nNonce = i;
+  sha256_to_str(UBEGIN(benchBlock.nVersion), SHA256_LEN + 1, str, digest);
+}
+
+static void BenchDoubleSha(u32int i)
+{
+  //two merkle tree nodes, the same 64 bytes a txid pair is hashed from
+  uint256 left = i, right = hashBench;
+  hashBench = Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+}
+
+static void BenchBlockGetHash(u32int i)
+{
+  benchBlock.nNonce = i;
+  hashBench = benchBlock.GetHash();
+}
+
+struct CBench
+{
+  const char *pszName;
+  void (*pfn)(u32int i);
+  u32int nHashesPerOp;
+  u32int nOpsScale;   //cheap benchmarks run this many times more ops
+};
+
+static const CBench vBenches[] = {
+  {"dcrypt",            BenchDcrypt,       1,                       1},
+  {"dcrypt_multi",      BenchDcryptMulti,  SHA256_MAX_LANES * 16,   1},
+  {"CBlock::GetHash",   BenchBlockGetHash, 1,                       1},
+  {"sha256_to_str",     BenchSha256ToStr,  1,                       1000},
+  {"Hash (double sha)", BenchDoubleSha,    1,                       1000},
+};
+
+static void RunBench(const CBench &bench, u32int nOps)
+{
+  if(bench.nHashesPerOp > 1)
+    nOps = std::max((u32int)1, nOps / bench.nHashesPerOp);
+  nOps *= bench.nOpsScale;
+
+  //warm up so caches and per-thread scratch are set up before timing
+  bench.pfn(0);
+
+  uint64 nAllocsStart = nAllocs;
+  int64 nStart = GetPerformanceCounter();
+
+  for(u32int i = 0; i < nOps; i++)
+    bench.pfn(i);
+
+  int64 nElapsed = std::max(GetPerformanceCounter() - nStart, (int64)1);
+  uint64 nHashes = (uint64)nOps * bench.nHashesPerOp;
+
+  printf("%-20s %10"PRI64u" %14.1f %14.1f",
+         bench.pszName, nHashes, nHashes * 1000000.0 / nElapsed, nElapsed * 1000.0 / nHashes);
+
+  if(BENCH_COUNTS_ALLOCS)
+    printf(" %12.2f\n", (double)(nAllocs - nAllocsStart) / nHashes);
+  else
+    printf(" %12s\n", "n/a");
+}
+
+//how many rounds the dcrypt mix loop runs, over the same headers the benchmarks hash
+static void MixRoundsDistribution(u32int nHeaders)
+{
+  std::vector<uint64> vRounds;
+  std::map<int, u32int> mapBuckets;
+  uint64 nTotal = 0;
+
+  vRounds.reserve(nHeaders);
+  for(u32int i = 0; i < nHeaders; i++)
+  {
+    uint64 nRounds;
+    benchBlock.nNonce = i;
+    dcrypt(UBEGIN(benchBlock.nVersion), HASH_BLOCK_SIZE(benchBlock), &nRounds);
+
+    vRounds.push_back(nRounds);
+    nTotal += nRounds;
+
+    //power of two buckets
+    int nBucket = 0;
+    while((2ULL << nBucket) <= nRounds)
+      nBucket++;
+    mapBuckets[nBucket]++;
+  }
+
+  std::sort(vRounds.begin(), vRounds.end());
+
+  printf("\nDcrypt mix rounds over %u headers:\n", nHeaders);
+  printf("  min %"PRI64u"  mean %.1f  median %"PRI64u"  p90 %"PRI64u"  p99 %"PRI64u"  max %"PRI64u"\n",
+         vRounds.front(), (double)nTotal / nHeaders, vRounds[nHeaders / 2],
+         vRounds[nHeaders * 9 / 10], vRounds[nHeaders * 99 / 100], vRounds.back());
+
+  for(std::map<int, u32int>::const_iterator it = mapBuckets.begin(); it != mapBuckets.end(); ++it)
+    printf("  %6llu - %-6llu %6.2f%% %s\n", 1ULL << it->first, (2ULL << it->first) - 1,
+           100.0 * it->second / nHeaders, std::string(it->second * 60 / nHeaders, '#').c_str());
+}
+
+int main(int argc, char* argv[])
+{
+  fPrintToConsole = true;
+  ParseParameters(argc, argv);
+
+  const u32int nOps = std::max((int64)1, GetArg("-n", 2000));
+
+  SetupBenchBlock();
+  if(benchBlock.GetHash() != hashGenesisBlockOfficial)
+  {
+    printf("bench_heat: genesis header does not hash to the genesis block, dcrypt is broken\n");
+    return 1;
+  }
+
+  printf("bench_heat: %u ops, dcrypt lanes %u\n\n", nOps,
+         sha256_lanes_init(GetArg("-dcryptlanes", SHA256_LANES_AUTO)));
+  printf("%-20s %10s %14s %14s %12s\n", "benchmark", "hashes", "hashes/s", "ns/hash", "allocs/hash");
+
+  for(u32int i = 0; i < sizeof(vBenches) / sizeof(vBenches[0]); i++)
+    RunBench(vBenches[i], nOps);
+
+  MixRoundsDistribution(nOps);
+
+  return 0;
+}
@@ -583,6 +583,53 @@ Value getmininginfo(const Array& params, bool fHelp)
 }
 
 
+Value getminingstats(const Array& params, bool fHelp)
+{
+  if(fHelp || params.size() != 0)
+    throw runtime_error(
+      "getminingstats\n"
+      "Returns per thread proof-of-work hashing statistics.");
+
+  Array threads;
+  uint64 nHashes = 0, nMixRounds = 0, nStaleWork = 0;
+  double dTotalHashesPerSec = 0;
+  int64 nNow = GetTimeMillis();
+
+  for(int i = 0; i < MAX_MINER_STATS_THREADS; i++)
+  {
+    const CMinerThreadStats &stats = vMinerThreadStats[i];
+    if(!stats.fInUse)
+      continue;
+
+    uint64 nThreadHashes = stats.nHashes, nThreadMixRounds = stats.nMixRounds;
+
+    Object thread;
+    thread.push_back(Pair("thread",        i));
+    thread.push_back(Pair("hashespersec",  (boost::int64_t)stats.dHashesPerSec));
+    thread.push_back(Pair("hashes",        (boost::uint64_t)nThreadHashes));
+    thread.push_back(Pair("avgmixrounds",  nThreadHashes ? (double)nThreadMixRounds / nThreadHashes : 0.0));
+    thread.push_back(Pair("stalework",     (boost::uint64_t)stats.nStaleWork));
+    thread.push_back(Pair("seconds",       (boost::int64_t)((nNow - stats.nStartTime) / 1000)));
+    threads.push_back(thread);
+
+    nHashes += nThreadHashes;
+    nMixRounds += nThreadMixRounds;
+    nStaleWork += stats.nStaleWork;
+    dTotalHashesPerSec += stats.dHashesPerSec;
+  }
+
+  Object obj;
+  obj.push_back(Pair("threads",          threads));
+  obj.push_back(Pair("hashespersec",     (boost::int64_t)dTotalHashesPerSec));
+  obj.push_back(Pair("avgmixrounds",     nHashes ? (double)nMixRounds / nHashes : 0.0));
+  obj.push_back(Pair("templatesbuilt",   (int)nMinerTemplatesBuilt));
+  obj.push_back(Pair("stalework",        (boost::uint64_t)nStaleWork));
+  obj.push_back(Pair("lasttemplate",     nMinerTemplateTime ? (boost::int64_t)(GetTime() - nMinerTemplateTime) : -1));
+  obj.push_back(Pair("genproclimit",     (int)GetArg("-genproclimit", -1)));
+  return obj;
+}
+
+
 Value getnewaddress(const Array& params, bool fHelp)
 {
   if(fHelp || params.size() > 1)
@@ -1124,6 +1171,157 @@ Value calcburnhash(const Array &params, bool fHelp)
   return output;
 }
 
+Value simulateburnhashes(const Array &params, bool fHelp)
+{
+  if(fHelp || params.size() > 2)
+    throw runtime_error(
+      "simulateburnhashes [horizon=10] [[\"txid\",\"txid:n\",...]]\n"
+      "Projects the burn hashes of the given burn transactions, or of all of the wallet's,\n"
+      "over the next <horizon> proof-of-work blocks. Step 0 is the best block as it is,\n"
+      "step k assumes k more proof-of-work blocks and no proof-of-burn block in between.\n"
+      "The hashes of blocks to come are not known yet, so every step uses the best block's\n"
+      "hash and only the multiplier and the projected target change from step to step");
+
+  s32int nHorizon = 10;
+  if(params.size() > 0)
+    nHorizon = params[0].get_int();
+  if(nHorizon < 0 || nHorizon > 1000)
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "horizon must be between 0 and 1000");
+
+  if(!pindexBest)
+    throw JSONRPCError(RPC_MISC_ERROR, "No best block");
+
+  std::vector<CBurnSimulation> vSims;
+  std::vector<s32int> vOut;
+
+  if(params.size() > 1)
+  {
+    BOOST_FOREACH(const Value &value, params[1].get_array())
+    {
+      //either a burn transaction's id or one of its outpoints
+      const string strOutPoint = value.get_str();
+      const size_t nColon = strOutPoint.find(':');
+      const uint256 hashTx(strOutPoint.substr(0, nColon));
+
+      CTransaction tx;
+      uint256 hashBlock = 0;
+      if(!GetTransaction(hashTx, tx, hashBlock))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction " + strOutPoint);
+
+      map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+      if(!hashBlock || mi == mapBlockIndex.end() || !mi->second->IsInMainChain())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Transaction " + strOutPoint + " is not in the main chain");
+
+      const s32int nOut = nColon == string::npos ? tx.GetBurnOutTxIndex() : atoi(strOutPoint.substr(nColon + 1));
+      CBitcoinAddress address;
+      if(nOut < 0 || nOut >= (s32int)tx.vout.size() || !ExtractAddress(tx.vout[nOut].scriptPubKey, address) || 
+         !IsBurnAddress(address) || !tx.vout[nOut].nValue)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Not a burn outpoint " + strOutPoint);
+
+      CBurnSimulation sim;
+      sim.hashTx = hashTx;
+      sim.hashBlock = hashBlock;
+      sim.nHeight = mi->second->nHeight;
+      sim.nValue = tx.vout[nOut].nValue;
+      vSims.push_back(sim);
+      vOut.push_back(nOut);
+    }
+  }else{
+    BOOST_FOREACH(const uint256 &hashTx, pwalletMain->setBurnHashes)
+    {
+      map<uint256, CWalletTx>::const_iterator mi = pwalletMain->mapWallet.find(hashTx);
+      if(mi == pwalletMain->mapWallet.end())
+        continue;
+      const CWalletTx &wtx = mi->second;
+
+      //skip the ones not in the main chain
+      if(!wtx.hashBlock || wtx.GetDepthInMainChain() <= 0 || !mapBlockIndex.count(wtx.hashBlock))
+        continue;
+
+      const s32int nOut = wtx.GetBurnOutTxIndex();
+      if(nOut < 0 || !wtx.vout[nOut].nValue)
+        continue;
+
+      CBurnSimulation sim;
+      sim.hashTx = hashTx;
+      sim.hashBlock = wtx.hashBlock;
+      sim.nHeight = mapBlockIndex[wtx.hashBlock]->nHeight;
+      sim.nValue = wtx.vout[nOut].nValue;
+      vSims.push_back(sim);
+      vOut.push_back(nOut);
+    }
+  }
+
+  SimulateBurnHashes(vSims, nHorizon);
+
+  //the projected target of every step and the smallest hash against it
+  Array steps;
+  for(s32int nStep = 0; nStep <= nHorizon; nStep++)
+  {
+    const u32int nBurnBits = GetProjectedBurnTarget(pindexBest, nStep);
+    const uint256 target = CBigNum().SetCompact(nBurnBits).getuint256();
+
+    uint256 smallestHash = ~uint256(0);
+    const CBurnSimulation *psimSmallest = NULL;
+    for(u32int i = 0; i < vSims.size(); i++)
+    {
+      if(vSims[i].vHashes[nStep] < smallestHash)
+      {
+        smallestHash = vSims[i].vHashes[nStep];
+        psimSmallest = &vSims[i];
+      }
+    }
+
+    Object step;
+    step.push_back(Pair("step", nStep));
+    step.push_back(Pair("nBurnBits", strprintf("%08x", nBurnBits)));
+    step.push_back(Pair("target", target.GetHex()));
+    if(psimSmallest)
+    {
+      step.push_back(Pair("smallesthash", smallestHash.GetHex()));
+      step.push_back(Pair("txid", psimSmallest->hashTx.GetHex()));
+      step.push_back(Pair("meetstarget", smallestHash <= target));
+    }
+    steps.push_back(step);
+  }
+
+  Array burns;
+  for(u32int i = 0; i < vSims.size(); i++)
+  {
+    const CBurnSimulation &sim = vSims[i];
+
+    Array hashes;
+    for(s32int nStep = 0; nStep <= nHorizon; nStep++)
+    {
+      const s32int between = sim.GetBetween(nStep);
+
+      Object entry;
+      entry.push_back(Pair("step", nStep));
+      entry.push_back(Pair("between", between));
+      entry.push_back(Pair("multiplier", calculate_burn_multiplier(sim.nValue, between)));
+      if(sim.vHashes[nStep] != ~uint256(0))
+        entry.push_back(Pair("hash", sim.vHashes[nStep].GetHex()));
+      hashes.push_back(entry);
+    }
+
+    Object burn;
+    burn.push_back(Pair("txid", sim.hashTx.GetHex()));
+    burn.push_back(Pair("vout", vOut[i]));
+    burn.push_back(Pair("amount", ValueFromAmount(sim.nValue)));
+    burn.push_back(Pair("height", sim.nHeight));
+    burn.push_back(Pair("intermediate", sim.hashIntermediate.GetHex()));
+    burn.push_back(Pair("hashes", hashes));
+    burns.push_back(burn);
+  }
+
+  Object ret;
+  ret.push_back(Pair("bestblock", pindexBest->GetBlockHash().GetHex()));
+  ret.push_back(Pair("height", pindexBest->nHeight));
+  ret.push_back(Pair("steps", steps));
+  ret.push_back(Pair("burns", burns));
+  return ret;
+}
+
 Value burncoins(const Array &params, bool fHelp)
 {
   if(fHelp || params.size() < 2 || params.size() > 5)
@@ -1241,6 +1439,61 @@ Value getburndata(const Array &params, bool fHelp)
   return ret;
 }
 
+Value getburnstats(const Array &params, bool fHelp)
+{
+  if(fHelp || params.size() < 1 || params.size() > 2)
+    throw runtime_error(
+      "getburnstats <fromheight> [toheight=fromheight]\n"
+      "Lists the proof-of-burn statistics of the main chain blocks in the range, with totals\n"
+      "over it, at most 10000 blocks at a time. Needs the node started with -burnindex");
+
+  if(!fBurnIndex)
+    throw JSONRPCError(RPC_MISC_ERROR, "The burn index is off, start with -burnindex");
+
+  const int nFrom = params[0].get_int();
+  const int nTo = params.size() > 1 ? params[1].get_int() : nFrom;
+  if(nFrom < 0 || nTo < nFrom || nTo > nBestHeight)
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+  if(nTo - nFrom >= 10000)
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "At most 10000 blocks at a time");
+
+  CTxDB txdb("r");
+  Array blocks;
+  int64 nBurnedCoins = 0;
+  int nPoBBlocks = 0;
+  for(int nHeight = nFrom; nHeight <= nTo; nHeight++)
+  {
+    CBurnStats stats;
+    if(!txdb.ReadBurnStats(nHeight, stats))
+      throw JSONRPCError(RPC_DATABASE_ERROR, strprintf("No burn index record for height %d", nHeight));
+
+    nBurnedCoins += stats.nBurnedCoins;
+
+    Object entry;
+    entry.push_back(Pair("height", nHeight));
+    entry.push_back(Pair("hash", stats.hashBlock.GetHex()));
+    entry.push_back(Pair("burnt", ValueFromAmount(stats.nBurnedCoins)));
+    entry.push_back(Pair("totalburnt", ValueFromAmount(stats.nTotalBurnedCoins)));
+    entry.push_back(Pair("effectiveburncoins", ValueFromAmount(stats.nEffectiveBurnCoins)));
+    entry.push_back(Pair("nBurnBits", strprintf("%08x", stats.nBurnBits)));
+    if(stats.IsProofOfBurn())
+    {
+      nPoBBlocks++;
+      entry.push_back(Pair("burntx", strprintf("%d:%d:%d", stats.burnBlkHeight, stats.burnCTx, stats.burnCTxOut)));
+      entry.push_back(Pair("burnhash", stats.burnHash.GetHex()));
+    }
+    blocks.push_back(entry);
+  }
+
+  Object ret;
+  ret.push_back(Pair("from", nFrom));
+  ret.push_back(Pair("to", nTo));
+  ret.push_back(Pair("burnt", ValueFromAmount(nBurnedCoins)));
+  ret.push_back(Pair("pobblocks", nPoBBlocks));
+  ret.push_back(Pair("blocks", blocks));
+  return ret;
+}
+
 Value sendfrom(const Array &params, bool fHelp)
 {
   if(fHelp || params.size() < 3 || params.size() > 6)
@@ -2217,6 +2470,7 @@ Value signrawtransaction(const Array& params, bool fHelp)
   // mergedTx will end up with all the signatures; it
   // starts as a clone of the rawtx:
   CTransaction mergedTx(txVariants[0]);
+  mergedTx.InvalidateHash(); //signed in place below
   bool fComplete = true;
 
   // Fetch previous transactions (inputs):
@@ -2648,6 +2902,166 @@ Value validateaddress(const Array& params, bool fHelp)
   return ret;
 }
 
+//
+// Block template shared by getwork, getblocktemplate and getmemorypool
+//
+
+//how long a template is handed out after the mempool changed before it is updated
+#define TEMPLATE_REFRESH_SECS 5
+
+static CBlock *pblockTemplate = NULL;
+static CNewBlockState stateTemplate;
+static CBlockIndex *pindexTemplatePrev = NULL;
+static unsigned int nTemplateTxUpdated = 0;
+static int64 nTemplateStart = 0;
+static unsigned int nTemplateId = 0; //bumped whenever the transactions change
+
+//getblocktemplate's per transaction data, carried over between templates so
+// only transactions new to the template have their inputs fetched
+struct CTemplateTxInfo
+{
+  string strHex;
+  int64 nFee;
+  int64 nSigOps;
+  vector<uint256> vPrevTx;
+};
+static map<uint256, CTemplateTxInfo> mapTemplateTxInfo;
+static unsigned int nTemplateTxInfoId = 0;
+
+//returns the current template, every caller shares it. It is rebuilt when the tip
+// moves, and when the mempool changed and it is older than TEMPLATE_REFRESH_SECS
+// the new mempool transactions are added to it. cs_main must be held
+static CBlock *GetBlockTemplate()
+{
+  if(!pblockTemplate || pindexTemplatePrev != pindexBest)
+  {
+    // Store the pindexBest used before CreateNewBlock, to avoid races
+    unsigned int nTxUpdatedNew = nTransactionsUpdated;
+    CBlockIndex *pindexPrevNew = pindexBest;
+
+    CBlock *pblock = CreateNewBlock(pwalletMain, false, NULL, pMiningKey, &stateTemplate);
+    if(!pblock)
+      throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+
+    // Need to update only after we know CreateNewBlock succeeded
+    delete pblockTemplate;
+    pblockTemplate = pblock;
+    pindexTemplatePrev = pindexPrevNew;
+    nTemplateTxUpdated = nTxUpdatedNew;
+    nTemplateStart = GetTime();
+    nTemplateId++;
+  }
+  else if(nTransactionsUpdated != nTemplateTxUpdated && GetTime() - nTemplateStart > TEMPLATE_REFRESH_SECS)
+  {
+    //same tip, so everything in the template still connects and only the
+    // transactions that arrived since are looked at
+    unsigned int nTxUpdatedNew = nTransactionsUpdated;
+    if(AddToNewBlock(pblockTemplate, stateTemplate))
+      nTemplateId++;
+    nTemplateTxUpdated = nTxUpdatedNew;
+    nTemplateStart = GetTime();
+  }
+
+  // Update nTime
+  pblockTemplate->UpdateTime(pindexTemplatePrev);
+  pblockTemplate->nNonce = 0;
+
+  return pblockTemplate;
+}
+
+//fills mapTemplateTxInfo for the current template
+static void UpdateTemplateTxInfo()
+{
+  if(nTemplateTxInfoId == nTemplateId)
+    return;
+
+  map<uint256, CTemplateTxInfo> mapTxInfoNew;
+  CTxDB txdb("r");
+  BOOST_FOREACH(CTransaction &tx, pblockTemplate->vtx)
+  {
+    if(tx.IsCoinBase())
+      continue;
+
+    uint256 txHash = tx.GetHash();
+    map<uint256, CTemplateTxInfo>::iterator mi = mapTemplateTxInfo.find(txHash);
+    if(mi != mapTemplateTxInfo.end() && mi->second.nFee >= 0)
+    {
+      mapTxInfoNew[txHash] = mi->second;
+      continue;
+    }
+
+    CTemplateTxInfo &info = mapTxInfoNew[txHash];
+
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << tx;
+    info.strHex = HexStr(ssTx.begin(), ssTx.end());
+
+    //inputs that can't be fetched leave the fee unknown (-1), they are
+    // fetched again for the next template
+    MapPrevTx mapInputs;
+    map<uint256, CTxIndex> mapUnused;
+    bool fInvalid = false;
+    if(tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid))
+    {
+      info.nFee = tx.GetValueIn(mapInputs) - tx.GetValueOut();
+      info.nSigOps = tx.GetLegacySigOpCount() + tx.GetP2SHSigOpCount(mapInputs);
+      BOOST_FOREACH(MapPrevTx::value_type& inp, mapInputs)
+        info.vPrevTx.push_back(inp.first);
+    }
+    else
+      info.nFee = -1;
+  }
+
+  mapTemplateTxInfo.swap(mapTxInfoNew);
+  nTemplateTxInfoId = nTemplateId;
+}
+
+static string GetLongPollId()
+{
+  return pindexTemplatePrev->GetBlockHash().GetHex() + strprintf("%u", nTemplateTxUpdated);
+}
+
+//BIP22 long polling, blocks a getblocktemplate call carrying a longpollid until
+// the tip changes or the mempool changed and a new template would be built.
+// Called from the connection handler before the call is executed, so no lock
+// is held while waiting.
+static void WaitForLongPoll(const Array &params)
+{
+  if(params.size() == 0 || params[0].type() != obj_type)
+    return;
+
+  const Value &lpval = find_value(params[0].get_obj(), "longpollid");
+  if(lpval.type() != str_type)
+    return;
+
+  const string &strLongPollId = lpval.get_str();
+  if(strLongPollId.size() < 64)
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid longpollid");
+
+  uint256 hashWatched;
+  hashWatched.SetHex(strLongPollId.substr(0, 64));
+  unsigned int nTxUpdatedWatched = atoi(strLongPollId.substr(64).c_str());
+  int64 nRefreshTime = GetTimeMillis() + TEMPLATE_REFRESH_SECS * 1000;
+
+  //the tip moved on since the id was handed out
+  const CBlockIndex *pindexWatched = pindexBest;
+  if(pindexWatched->GetBlockHash() != hashWatched)
+    return;
+
+  //a new block wakes the wait, only the mempool refresh is timed
+  while(!fShutdown)
+  {
+    int64 nWait = nRefreshTime - GetTimeMillis();
+    if(WaitForTipChange(pindexWatched, nWait > 0 ? nWait : TEMPLATE_REFRESH_SECS * 1000))
+      break;
+    if(nTransactionsUpdated != nTxUpdatedWatched && GetTimeMillis() >= nRefreshTime)
+      break;
+  }
+
+  if(fShutdown)
+    throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "heat is shutting down");
+}
+
 Value getwork(const Array& params, bool fHelp)
 {
   if(fHelp || params.size() > 1)
@@ -2658,7 +3072,8 @@ Value getwork(const Array& params, bool fHelp)
       "  \"data\" : block data\n"
       "  \"hash1\" : formatted hash buffer for second hash (DEPRECATED)\n" // deprecated
       "  \"target\" : little endian hash target\n"
-      "If [data] is specified, tries to solve the block and returns true if it was successful.");
+      "If [data] is specified, tries to solve the block and returns true if it was successful.\n"
+      "Requests to the /LP path wait for a new block before returning work.");
 
   if(vNodes.empty())
     throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "heat is not connected!");
@@ -2674,13 +3089,13 @@ Value getwork(const Array& params, bool fHelp)
   if(params.size() == 0)
   {
     // Update block
-    static unsigned int nTransactionsUpdatedLast;
     static CBlockIndex* pindexPrev;
-    static int64 nStart;
+    static unsigned int nTemplateIdLast;
     static CBlock* pblock;
-    if(pindexPrev != pindexBest || (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60))
+    CBlock *ptemplate = GetBlockTemplate();
+    if(pindexPrev != pindexTemplatePrev || nTemplateIdLast != nTemplateId)
     {
-      if(pindexPrev != pindexBest)
+      if(pindexPrev != pindexTemplatePrev)
       {
         // Deallocate old blocks since they're obsolete now
         mapNewBlock.clear();
@@ -2689,14 +3104,11 @@ Value getwork(const Array& params, bool fHelp)
         vNewBlock.clear();
       }
 
-      nTransactionsUpdatedLast = nTransactionsUpdated;
-      pindexPrev = pindexBest;
-      nStart = GetTime();
+      pindexPrev = pindexTemplatePrev;
+      nTemplateIdLast = nTemplateId;
 
-      // Create new block
-      pblock = CreateNewBlock(pwalletMain);
-      if(!pblock)
-        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+      //getwork changes the coinbase, so it works on its own copy of the template
+      pblock = new CBlock(*ptemplate);
       vNewBlock.push_back(pblock);
     }
 
@@ -2749,7 +3161,8 @@ Value getwork(const Array& params, bool fHelp)
     if(!pblock->SignBlock(*pwalletMain))
       throw JSONRPCError(RPC_UNABLE_TO_SIGN_BLOCK, "Unable to sign block, wallet locked?");
 
-    return CheckWork(pblock, *pwalletMain, reservekey);
+    //the template's coinbase pays to pMiningKey
+    return CheckWork(pblock, *pwalletMain, pMiningKey ? *pMiningKey : reservekey);
   }
 }
 
@@ -2773,6 +3186,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
       " \"sizelimit\" : limit of block size\n"
       " \"bits\" : compressed target of next block\n"
       " \"height\" : height of the next block\n"
+      " \"longpollid\" : pass back in [params] to wait for the next template\n"
       "See https://en.bitcoin.it/wiki/BIP_0022 for full specification.");
 
   std::string strMode = "template";
@@ -2802,43 +3216,13 @@ Value getblocktemplate(const Array& params, bool fHelp)
       throw JSONRPCError(-10, "heat is downloading blocks...");
 
     // Update block
-    static unsigned int nTransactionsUpdatedLast;
-    static CBlockIndex *pindexPrev;
-    static int64 nStart;
-    static CBlock *pblock;
-    if (pindexPrev != pindexBest ||
-        (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 5))
-    {
-      // Clear pindexPrev so future calls make a new block, despite any failures from here on
-      pindexPrev = NULL;
-
-      // Store the pindexBest used before CreateNewBlock, to avoid races
-      nTransactionsUpdatedLast = nTransactionsUpdated;
-      CBlockIndex* pindexPrevNew = pindexBest;
-      nStart = GetTime();
-
-      // Create new block
-      if(pblock)
-      {
-        delete pblock;
-        pblock = NULL;
-      }
-      pblock = CreateNewBlock(pwalletMain, false, NULL, pMiningKey);
-      if(!pblock)
-        throw JSONRPCError(-7, "Out of memory");
-
-      // Need to update only after we know CreateNewBlock succeeded
-      pindexPrev = pindexPrevNew;
-    }
-
-    // Update nTime
-    pblock->UpdateTime(pindexPrev);
-    pblock->nNonce = 0;
+    CBlock *pblock = GetBlockTemplate();
+    CBlockIndex *pindexPrev = pindexTemplatePrev;
+    UpdateTemplateTxInfo();
 
     Array transactions;
     map<uint256, int64_t> setTxIndex;
     int i = 0;
-    CTxDB txdb("r");
     BOOST_FOREACH(CTransaction &tx, pblock->vtx)
     {
       uint256 txHash = tx.GetHash();
@@ -2847,32 +3231,25 @@ Value getblocktemplate(const Array& params, bool fHelp)
       if (tx.IsCoinBase())
         continue;
 
-      Object entry;
-
-      CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-      ssTx << tx;
-      entry.push_back(Pair("data", HexStr(ssTx.begin(), ssTx.end())));
+      const CTemplateTxInfo &info = mapTemplateTxInfo[txHash];
 
+      Object entry;
+      entry.push_back(Pair("data", info.strHex));
       entry.push_back(Pair("hash", txHash.GetHex()));
 
-      MapPrevTx mapInputs;
-      map<uint256, CTxIndex> mapUnused;
-      bool fInvalid = false;
-      if (tx.FetchInputs(txdb, mapUnused, false, false, mapInputs, fInvalid))
+      if(info.nFee >= 0)
       {
-        entry.push_back(Pair("fee", (int64_t)(tx.GetValueIn(mapInputs) - tx.GetValueOut())));
+        entry.push_back(Pair("fee", (int64_t)info.nFee));
 
         Array deps;
-        BOOST_FOREACH (MapPrevTx::value_type& inp, mapInputs)
+        BOOST_FOREACH(const uint256 &hashPrev, info.vPrevTx)
         {
-          if (setTxIndex.count(inp.first))
-            deps.push_back(setTxIndex[inp.first]);
+          if (setTxIndex.count(hashPrev))
+            deps.push_back(setTxIndex[hashPrev]);
         }
         entry.push_back(Pair("depends", deps));
 
-        int64_t nSigOps = tx.GetLegacySigOpCount();
-        nSigOps += tx.GetP2SHSigOpCount(mapInputs);
-        entry.push_back(Pair("sigops", nSigOps));
+        entry.push_back(Pair("sigops", (int64_t)info.nSigOps));
       }
 
       transactions.push_back(entry);
@@ -2897,6 +3274,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
     result.push_back(Pair("transactions", transactions));
     result.push_back(Pair("coinbaseaux", aux));
     result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0].vout[0].nValue));
+    result.push_back(Pair("longpollid", GetLongPollId()));
     result.push_back(Pair("target", hashTarget.GetHex()));
     result.push_back(Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast() + 1));
     result.push_back(Pair("mutable", aMutable));
@@ -2992,34 +3370,12 @@ Value getmemorypool(const Array& params, bool fHelp)
     if(IsInitialBlockDownload())
       throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "SLIMCoin is downloading blocks...");
 
-    static CReserveKey reservekey(pwalletMain);
-
     // Update block
-    static unsigned int nTransactionsUpdatedLast;
-    static CBlockIndex* pindexPrev;
-    static int64 nStart;
-    static CBlock* pblock;
-    if(pindexPrev != pindexBest ||
-       (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 5))
-    {
-      nTransactionsUpdatedLast = nTransactionsUpdated;
-      pindexPrev = pindexBest;
-      nStart = GetTime();
-
-      // Create new block
-      if(pblock)
-        delete pblock;
-      pblock = CreateNewBlock(pwalletMain);
-      if(!pblock)
-        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-    }
-
-    // Update nTime
-    pblock->UpdateTime(pindexPrev);
-    pblock->nNonce = 0;
+    CBlock *pblock = GetBlockTemplate();
+    CBlockIndex *pindexPrev = pindexTemplatePrev;
 
     Array transactions;
-    BOOST_FOREACH(CTransaction tx, pblock->vtx) {
+    BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
       if(tx.IsCoinBase() || tx.IsCoinStake())
         continue;
 
@@ -3052,7 +3408,7 @@ Value getmemorypool(const Array& params, bool fHelp)
     if(!pblock.SignBlock(*pwalletMain))
       throw JSONRPCError(RPC_UNABLE_TO_SIGN_BLOCK, "Unable to sign block, wallet locked?");
 
-    return CheckWork(&pblock, *pwalletMain, reservekey);
+    return CheckWork(&pblock, *pwalletMain, pMiningKey ? *pMiningKey : reservekey);
   }
 }
 
@@ -3067,10 +3423,7 @@ Value getblockhash(const Array& params, bool fHelp)
   if(nHeight < 0 || nHeight > nBestHeight)
     throw runtime_error("Block number out of range.");
 
-  CBlock block;
-  CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-  while(pblockindex->nHeight > nHeight)
-    pblockindex = pblockindex->pprev;
+  CBlockIndex* pblockindex = nHeight ? pindexByHeight(nHeight) : pindexGenesisBlock;
   return pblockindex->phashBlock->GetHex();
 }
 
@@ -3322,10 +3675,12 @@ static const CRPCCommand vRPCCommands[] =
   { "help",                     &help,                   true   },
   { "stop",                     &stop,                   true   },
   { "calcburnhash",             &calcburnhash,           true   },
+  { "simulateburnhashes",       &simulateburnhashes,     true   },
   { "burncoins",                &burncoins,              false  },
   { "getblockcount",            &getblockcount,          true   },
   { "getblocknumber",           &getblocknumber,         true   },
   { "getburndata",              &getburndata,            true   },
+  { "getburnstats",             &getburnstats,           true   },
   { "getconnectioncount",       &getconnectioncount,     true   },
   { "getdifficulty",            &getdifficulty,          true   },
   { "getpeerinfo",              &getpeerinfo,            true   },
@@ -3335,6 +3690,7 @@ static const CRPCCommand vRPCCommands[] =
   { "getnetworkghps",           &getnetworkghps,         true   },
   { "getinfo",                  &getinfo,                true   },
   { "getmininginfo",            &getmininginfo,          true   },
+  { "getminingstats",           &getminingstats,         true   },
   { "getnewaddress",            &getnewaddress,          true   },
   { "getaccountaddress",        &getaccountaddress,      true   },
   { "setaccount",               &setaccount,             true   },
@@ -3432,6 +3788,10 @@ string HTTPPost(const string& strMsg, const map<string,string>& mapRequestHeader
 
 string rfc1123Time()
 {
+  //gmtime and setlocale are shared by every RPC connection thread
+  static CCriticalSection cs_rfc1123Time;
+  LOCK(cs_rfc1123Time);
+
   char buffer[64];
   time_t now;
   time(&now);
@@ -3443,7 +3803,7 @@ string rfc1123Time()
   return string(buffer);
 }
 
-static string HTTPReply(int nStatus, const string& strMsg)
+static string HTTPReply(int nStatus, const string& strMsg, const string& strHeaders = "")
 {
   if(nStatus == 401)
     return strprintf("HTTP/1.0 401 Authorization Required\r\n"
@@ -3476,6 +3836,7 @@ static string HTTPReply(int nStatus, const string& strMsg)
     "Content-Length: %d\r\n"
     "Content-Type: application/json\r\n"
     "Server: heat-json-rpc/%s\r\n"
+    "%s"
     "\r\n"
     "%s",
     nStatus,
@@ -3483,6 +3844,7 @@ static string HTTPReply(int nStatus, const string& strMsg)
     rfc1123Time().c_str(),
     strMsg.size(),
     FormatFullVersion().c_str(),
+    strHeaders.c_str(),
     strMsg.c_str());
 }
 
@@ -3522,18 +3884,15 @@ int ReadHTTPHeader(std::basic_istream<char>& stream, map<string, string>& mapHea
   return nLen;
 }
 
-int ReadHTTP(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet, string& strMessageRet)
+static bool ReadHTTPMessage(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet, string& strMessageRet)
 {
   mapHeadersRet.clear();
   strMessageRet = "";
 
-  // Read status
-  int nStatus = ReadHTTPStatus(stream);
-
   // Read header
   int nLen = ReadHTTPHeader(stream, mapHeadersRet);
   if(nLen < 0 || nLen > (int)MAX_SIZE)
-    return 500;
+    return false;
 
   // Read message
   if(nLen > 0)
@@ -3543,9 +3902,33 @@ int ReadHTTP(std::basic_istream<char>& stream, map<string, string>& mapHeadersRe
     strMessageRet = string(vch.begin(), vch.end());
   }
 
+  return true;
+}
+
+int ReadHTTP(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet, string& strMessageRet)
+{
+  // Read status
+  int nStatus = ReadHTTPStatus(stream);
+
+  if(!ReadHTTPMessage(stream, mapHeadersRet, strMessageRet))
+    return 500;
+
   return nStatus;
 }
 
+//server side of ReadHTTP, the request line is "POST <path> HTTP/1.1"
+static void ReadHTTPRequest(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet,
+                            string& strPathRet, string& strMessageRet)
+{
+  string str;
+  getline(stream, str);
+  vector<string> vWords;
+  boost::split(vWords, str, boost::is_any_of(" "));
+  strPathRet = vWords.size() < 2 ? "" : vWords[1];
+
+  ReadHTTPMessage(stream, mapHeadersRet, strMessageRet);
+}
+
 bool HTTPAuthorized(map<string, string>& mapHeaders)
 {
   string strAuth = mapHeaders["authorization"];
@@ -3662,6 +4045,154 @@ private:
   SSLStream& stream;
 };
 
+//
+// One RPC caller's connection, handled on its own thread
+//
+class CRPCConnection
+{
+public:
+  SSLStream sslStream;
+  SSLIOStreamDevice d;
+  iostreams::stream<SSLIOStreamDevice> stream;
+  ip::tcp::endpoint peer;
+
+  CRPCConnection(asio::io_service &io_service, ssl::context &context, bool fUseSSL)
+    : sslStream(io_service, context), d(sslStream, fUseSSL), stream(d) {}
+};
+
+static void RPCConnection2(CRPCConnection *pconn)
+{
+  iostreams::stream<SSLIOStreamDevice> &stream = pconn->stream;
+
+  map<string, string> mapHeaders;
+  string strPath, strRequest;
+
+  //waited on in steps so an idle caller doesn't hold up shutdown
+  boost::thread api_caller(ReadHTTPRequest, boost::ref(stream), boost::ref(mapHeaders),
+                           boost::ref(strPath), boost::ref(strRequest));
+  int64 nTimeout = GetTime() + GetArg("-rpctimeout", 30);
+  while(!api_caller.timed_join(boost::posix_time::seconds(1)))
+  {
+    if(fShutdown || GetTime() >= nTimeout)
+    {   // Timed out:
+      boost::system::error_code ec;
+      pconn->sslStream.lowest_layer().shutdown(ip::tcp::socket::shutdown_both, ec);
+      api_caller.join();
+      if(!fShutdown)
+        printf("ThreadRPCServer ReadHTTP timeout\n");
+      return;
+    }
+  }
+
+  // Check authorization
+  if(mapHeaders.count("authorization") == 0)
+  {
+    stream << HTTPReply(401, "") << std::flush;
+    return;
+  }
+  if(!HTTPAuthorized(mapHeaders))
+  {
+    printf("ThreadRPCServer incorrect password attempt from %s\n",pconn->peer.address().to_string().c_str());
+    /* Deter brute-forcing short passwords.
+       If this results in a DOS the user really
+       shouldn't have their RPC port exposed.
+       Failed attempts are slowed one at a time, so parallel
+       connections don't multiply the guess rate.*/
+    if(mapArgs["-rpcpassword"].size() < 20)
+    {
+      static boost::mutex mutexAuthFailure;
+      boost::lock_guard<boost::mutex> lock(mutexAuthFailure);
+      Sleep(250);
+    }
+
+    stream << HTTPReply(401, "") << std::flush;
+    return;
+  }
+
+  Value id = Value::null;
+  try
+  {
+    // Parse request
+    Value valRequest;
+    if(!read_string(strRequest, valRequest) || valRequest.type() != obj_type)
+      throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+    const Object& request = valRequest.get_obj();
+
+    // Parse id now so errors from here on will have the id
+    id = find_value(request, "id");
+
+    // Parse method
+    Value valMethod = find_value(request, "method");
+    if(valMethod.type() == null_type)
+      throw JSONRPCError(RPC_INVALID_REQUEST, "Missing method");
+    if(valMethod.type() != str_type)
+      throw JSONRPCError(RPC_INVALID_REQUEST, "Method must be a string");
+    string strMethod = valMethod.get_str();
+    if(strMethod != "getwork" && strMethod != "getmemorypool" && strMethod != "getblocktemplate")
+      printf("ThreadRPCServer method=%s\n", strMethod.c_str());
+
+    // Parse params
+    Value valParams = find_value(request, "params");
+    Array params;
+    if(valParams.type() == array_type)
+      params = valParams.get_array();
+    else if(valParams.type() == null_type)
+      params = Array();
+    else
+      throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
+
+    try
+    {
+      //long polling, the caller is held here, outside of any lock, until
+      // there is a new block or template to work on
+      if(strPath == "/LP" && strMethod == "getwork" && params.size() == 0)
+      {
+        CBlockIndex *pindexWatched = pindexBest;
+        while(!WaitForTipChange(pindexWatched, 60 * 1000) && !fShutdown) ;
+      }
+      else if(strMethod == "getblocktemplate")
+        WaitForLongPoll(params);
+
+      // Execute
+      Value result = tableRPC.execute(strMethod, params);
+
+      // Send reply
+      string strReply = JSONRPCReply(result, Value::null, id);
+      stream << HTTPReply(HTTP_OK, strReply, strMethod == "getwork" ? "X-Long-Polling: /LP\r\n" : "") << std::flush;
+    }
+    catch(std::exception& e)
+    {
+      ErrorReply(stream, JSONRPCError(RPC_MISC_ERROR, e.what()), id);
+    }
+  }
+  catch (Object& objError)
+  {
+    ErrorReply(stream, objError, id);
+  }
+  catch (std::exception& e)
+  {
+    ErrorReply(stream, JSONRPCError(RPC_PARSE_ERROR, e.what()), id);
+  }
+}
+
+static void ThreadRPCConnection(void* parg)
+{
+  CRPCConnection *pconn = (CRPCConnection*)parg;
+
+  try
+  {
+    RPCConnection2(pconn);
+  }
+  catch (std::exception& e) {
+    PrintExceptionContinue(&e, "ThreadRPCConnection()");
+  } catch (...) {
+    PrintExceptionContinue(NULL, "ThreadRPCConnection()");
+  }
+
+  delete pconn;
+  __sync_fetch_and_sub(&vnThreadsRunning[THREAD_RPCHANDLER], 1);
+}
+
 void ThreadRPCServer(void* parg)
 {
   IMPLEMENT_RANDOMIZE_STACK(ThreadRPCServer(parg));
@@ -3683,6 +4214,10 @@ void ThreadRPCServer(void* parg)
     PrintException(NULL, "ThreadRPCServer()");
   }
 
+  //connection threads still finishing a request may be using the key
+  while(vnThreadsRunning[THREAD_RPCHANDLER] > 0)
+    Sleep(20);
+
   delete pMiningKey; 
   pMiningKey = NULL;
 
@@ -3758,112 +4293,42 @@ void ThreadRPCServer2(void* parg)
     SSL_CTX_set_cipher_list(context.impl(), strCiphers.c_str());
   }
 
+  const int nMaxHandlers = std::max((int)GetArg("-rpcthreads", 16), 1);
   loop
   {
     // Accept connection
-    SSLStream sslStream(io_service, context);
-    SSLIOStreamDevice d(sslStream, fUseSSL);
-    iostreams::stream<SSLIOStreamDevice> stream(d);
+    CRPCConnection *pconn = new CRPCConnection(io_service, context, fUseSSL);
 
-    ip::tcp::endpoint peer;
     vnThreadsRunning[THREAD_RPCSERVER]--;
-    acceptor.accept(sslStream.lowest_layer(), peer);
-    vnThreadsRunning[4]++;
+    acceptor.accept(pconn->sslStream.lowest_layer(), pconn->peer);
+    vnThreadsRunning[THREAD_RPCSERVER]++;
     if(fShutdown)
+    {
+      delete pconn;
       return;
+    }
 
     // Restrict callers by IP
-    if(!ClientAllowed(peer.address().to_string()))
+    if(!ClientAllowed(pconn->peer.address().to_string()))
     {
       // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
       if(!fUseSSL)
-        stream << HTTPReply(403, "") << std::flush;
-      continue;
-    }
-
-    map<string, string> mapHeaders;
-    string strRequest;
-
-    boost::thread api_caller(ReadHTTP, boost::ref(stream), boost::ref(mapHeaders), boost::ref(strRequest));
-    if(!api_caller.timed_join(boost::posix_time::seconds(GetArg("-rpctimeout", 30))))
-    {   // Timed out:
-      acceptor.cancel();
-      printf("ThreadRPCServer ReadHTTP timeout\n");
-      continue;
-    }
-
-    // Check authorization
-    if(mapHeaders.count("authorization") == 0)
-    {
-      stream << HTTPReply(401, "") << std::flush;
-      continue;
-    }
-    if(!HTTPAuthorized(mapHeaders))
-    {
-      printf("ThreadRPCServer incorrect password attempt from %s\n",peer.address().to_string().c_str());
-      /* Deter brute-forcing short passwords.
-         If this results in a DOS the user really
-         shouldn't have their RPC port exposed.*/
-      if(mapArgs["-rpcpassword"].size() < 20)
-        Sleep(250);
-
-      stream << HTTPReply(401, "") << std::flush;
+        pconn->stream << HTTPReply(403, "") << std::flush;
+      delete pconn;
       continue;
     }
 
-    Value id = Value::null;
-    try
-    {
-      // Parse request
-      Value valRequest;
-      if(!read_string(strRequest, valRequest) || valRequest.type() != obj_type)
-        throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
-      const Object& request = valRequest.get_obj();
-
-      // Parse id now so errors from here on will have the id
-      id = find_value(request, "id");
-
-      // Parse method
-      Value valMethod = find_value(request, "method");
-      if(valMethod.type() == null_type)
-        throw JSONRPCError(RPC_INVALID_REQUEST, "Missing method");
-      if(valMethod.type() != str_type)
-        throw JSONRPCError(RPC_INVALID_REQUEST, "Method must be a string");
-      string strMethod = valMethod.get_str();
-      if(strMethod != "getwork" && strMethod != "getmemorypool" && strMethod != "getblocktemplate")
-        printf("ThreadRPCServer method=%s\n", strMethod.c_str());
-
-      // Parse params
-      Value valParams = find_value(request, "params");
-      Array params;
-      if(valParams.type() == array_type)
-        params = valParams.get_array();
-      else if(valParams.type() == null_type)
-        params = Array();
-      else
-        throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
+    //every caller gets its own thread so a long poll doesn't hold up the rest
+    while(vnThreadsRunning[THREAD_RPCHANDLER] >= nMaxHandlers && !fShutdown)
+      Sleep(10);
 
-      try
-      {
-        // Execute
-        Value result = tableRPC.execute(strMethod, params);
-
-        // Send reply
-        string strReply = JSONRPCReply(result, Value::null, id);
-        stream << HTTPReply(HTTP_OK, strReply) << std::flush;
-      }
-      catch(std::exception& e)
-      {
-        ErrorReply(stream, JSONRPCError(RPC_MISC_ERROR, e.what()), id);
-      }
-    }
-    catch (Object& objError)
-    {
-      ErrorReply(stream, objError, id);
-    }
-    catch (std::exception& e)
+    __sync_fetch_and_add(&vnThreadsRunning[THREAD_RPCHANDLER], 1);
+    if(fShutdown || !CreateThread(ThreadRPCConnection, pconn))
     {
-      ErrorReply(stream, JSONRPCError(RPC_PARSE_ERROR, e.what()), id);
+      if(!fShutdown)
+        printf("Error: CreateThread(ThreadRPCConnection) failed\n");
+      __sync_fetch_and_sub(&vnThreadsRunning[THREAD_RPCHANDLER], 1);
+      delete pconn;
     }
   }
 }
@@ -4007,6 +4472,10 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
   if(strMethod == "sendfrom"               && n > 2) ConvertTo<double>          (params[2]);
   if(strMethod == "sendfrom"               && n > 3) ConvertTo<boost::int64_t>  (params[3]);
   if(strMethod == "calcburnhash"           && n > 0) ConvertTo<bool>            (params[0]);
+  if(strMethod == "simulateburnhashes"     && n > 0) ConvertTo<boost::int64_t>  (params[0]);
+  if(strMethod == "simulateburnhashes"     && n > 1) ConvertTo<Array>           (params[1]);
+  if(strMethod == "getburnstats"           && n > 0) ConvertTo<boost::int64_t>  (params[0]);
+  if(strMethod == "getburnstats"           && n > 1) ConvertTo<boost::int64_t>  (params[1]);
   if(strMethod == "burncoins"              && n > 1) ConvertTo<double>          (params[1]);
   if(strMethod == "burncoins"              && n > 2) ConvertTo<boost::int64_t>  (params[2]);
   if(strMethod == "listtransactions"       && n > 1) ConvertTo<bool>            (params[1]);
@@ -481,6 +481,43 @@ bool CTxDB::EraseBlockIndex(uint256 hash)
   return Erase(make_pair(string("blockindex"), hash));
 }
 
+//the offsets of a block's transactions in its block file, by position in the block
+bool CTxDB::ReadBlockTxPos(uint256 hash, vector<unsigned int>& vTxPosRet)
+{
+  return Read(make_pair(string("blocktxpos"), hash), vTxPosRet);
+}
+
+bool CTxDB::WriteBlockTxPos(uint256 hash, const vector<unsigned int>& vTxPos)
+{
+  return Write(make_pair(string("blocktxpos"), hash), vTxPos);
+}
+
+//the -burnindex records, one per main chain height and the last block they were written for
+bool CTxDB::ReadBurnStats(int nHeight, CBurnStats& stats)
+{
+  return Read(make_pair(string("burnstats"), nHeight), stats);
+}
+
+bool CTxDB::WriteBurnStats(int nHeight, const CBurnStats& stats)
+{
+  return Write(make_pair(string("burnstats"), nHeight), stats);
+}
+
+bool CTxDB::EraseBurnStats(int nHeight)
+{
+  return Erase(make_pair(string("burnstats"), nHeight));
+}
+
+bool CTxDB::ReadBurnStatsBest(uint256& hashBest)
+{
+  return Read(string("burnstatsbest"), hashBest);
+}
+
+bool CTxDB::WriteBurnStatsBest(uint256 hashBest)
+{
+  return Write(string("burnstatsbest"), hashBest);
+}
+
 bool CTxDB::ReadHashBestChain(uint256& hashBestChain)
 {
   return Read(string("hashBestChain"), hashBestChain);
@@ -578,7 +615,12 @@ bool CTxDB::LoadBlockIndex()
         CDiskBlockIndex diskindex;
         ssValue >> diskindex;
 
-        uint256 blockHash = diskindex.GetBlockHash();
+        //records are keyed by their block hash, so the header only gets
+        // rehashed when -fastindex=0 asks for it to be checked
+        uint256 blockHash;
+        ssKey >> blockHash;
+        if(!fUseFastIndex && diskindex.CalcBlockHash() != blockHash)
+          return error("LoadBlockIndex() : block hash mismatch at %d", diskindex.nHeight);
 
         // Construct block index object
         CBlockIndex *pindexNew    = InsertBlockIndex(blockHash);
@@ -651,6 +693,7 @@ bool CTxDB::LoadBlockIndex()
   {
     CBlockIndex* pindex = item.second;
     pindex->bnChainTrust = (pindex->pprev ? pindex->pprev->bnChainTrust : 0) + pindex->GetBlockTrust();
+    pindex->SetChainCounts();
     // heat: calculate stake modifier checksum
     pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex);
     if(!CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
@@ -666,6 +709,7 @@ bool CTxDB::LoadBlockIndex()
   }
   if(!mapBlockIndex.count(hashBestChain))
     return error("CTxDB::LoadBlockIndex() : hashBestChain not found in the block index");
+  SetBestChainByHeight(mapBlockIndex[hashBestChain]);
   pindexBest = mapBlockIndex[hashBestChain];
   nBestHeight = pindexBest->nHeight;
   bnBestChainTrust = pindexBest->bnChainTrust;
@@ -18,6 +18,7 @@
 class CAddress;
 class CAddrMan;
 class CBlockLocator;
+class CBurnStats;
 class CDiskBlockIndex;
 class CDiskTxPos;
 class CMasterKey;
@@ -298,6 +299,13 @@ public:
   bool ReadDiskTx(COutPoint outpoint, CTransaction& tx);
   bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
   bool EraseBlockIndex(uint256 hash);
+  bool ReadBlockTxPos(uint256 hash, std::vector<unsigned int>& vTxPosRet);
+  bool WriteBlockTxPos(uint256 hash, const std::vector<unsigned int>& vTxPos);
+  bool ReadBurnStats(int nHeight, CBurnStats& stats);
+  bool WriteBurnStats(int nHeight, const CBurnStats& stats);
+  bool EraseBurnStats(int nHeight);
+  bool ReadBurnStatsBest(uint256& hashBest);
+  bool WriteBurnStatsBest(uint256 hashBest);
   bool ReadHashBestChain(uint256& hashBestChain);
   bool WriteHashBestChain(uint256 hashBestChain);
   bool ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust);
@@ -5,6 +5,8 @@
 #include <stdlib.h>        //malloc, free, realloc
 #include <math.h>          //pow
 
+#include <boost/thread/tss.hpp>
+
 #include "uint256.h"
 #include "main.h"
 #include "dcrypt.h"
@@ -12,6 +14,10 @@
 //the base size for malloc/realloc will be 1KB
 #define REALLOC_BASE_SZ   (1024)
 
+//the largest mix array a thread holds on to between hashes, anything bigger
+// is given back to the allocator once the hash is done
+#define SCRATCH_KEEP_SZ   (REALLOC_BASE_SZ * 256)
+
 typedef struct
 {
   uint8_t *array;
@@ -29,6 +35,54 @@ inline void Extend_Array_init(Extend_Array *ExtArray)
   return;
 }
 
+inline void Extend_Array_free(Extend_Array *ExtArray)
+{
+  free(ExtArray->array);
+  Extend_Array_init(ExtArray);
+  return;
+}
+
+//Working memory of dcrypt, one per thread so that miner and validation threads
+// never share it. The mix array keeps its capacity between hashes, so once it
+// has grown to fit a typical mix no more allocations are made.
+class CDcryptScratch
+{
+public:
+  Extend_Array mix;
+  uint8_t digest[DCRYPT_DIGEST_LENGTH];
+
+  CDcryptScratch()
+  {
+    Extend_Array_init(&mix);
+  }
+
+  ~CDcryptScratch()
+  {
+    Extend_Array_free(&mix);
+  }
+
+  //keeps the arena bounded after an unusually long mix
+  void Trim()
+  {
+    if(mix.actual_array_sz > SCRATCH_KEEP_SZ)
+      Extend_Array_free(&mix);
+  }
+};
+
+static boost::thread_specific_ptr<CDcryptScratch> pDcryptScratch;
+
+static CDcryptScratch *GetDcryptScratch()
+{
+  CDcryptScratch *pscratch = pDcryptScratch.get();
+  if(!pscratch)
+  {
+    pscratch = new CDcryptScratch();
+    pDcryptScratch.reset(pscratch);
+  }
+
+  return pscratch;
+}
+
 uint32_t hex_char_to_int(uint8_t c)
 {
   if(c >= '0' && c <= '9')
@@ -86,8 +140,10 @@ void extend_array(Extend_Array *extend_array, unsigned long long used_array_sz,
   return;
 }
 
+//mixes into new_hash, which may already hold memory from a previous call,
+// its old contents are overwritten and its capacity reused
 uint64 mix_hashed_nums(uint8_t *hashed_nums, const uint8_t *unhashedData, size_t unhashed_sz,
-                       uint8_t **mixed_hash, uint8_t *hash_digest)
+                       Extend_Array &new_hash, uint8_t *hash_digest)
 {
   uint32_t i, index = 0;
   const uint32_t hashed_nums_len = SHA256_LEN;
@@ -95,10 +151,6 @@ uint64 mix_hashed_nums(uint8_t *hashed_nums, const uint8_t *unhashedData, size_t
   uint64 count;
   uint8_t tmp_val, tmp_array[SHA256_LEN + 2];
 
-  //initialize the class for the extend hash
-  Extend_Array new_hash;
-  Extend_Array_init(&new_hash);
-
   //set the first hash length in the temp array to all 0xff
   memset(tmp_array, 0xff, SHA256_LEN);
   //set the last two bytes to \000
@@ -140,48 +192,354 @@ uint64 mix_hashed_nums(uint8_t *hashed_nums, const uint8_t *unhashedData, size_t
   //extend the unhashed data to the end and add the \000 to the end
   extend_array(&new_hash, count * SHA256_LEN, (u8int*)unhashedData, unhashed_sz, true);
 
-  //assign the address of new_hash's array to mixed_hash
-  *mixed_hash = new_hash.array;
+  return count * SHA256_LEN + unhashed_sz;
+}
+
+static const uint8_t hex_digits[] = "0123456789abcdef";
+
+//plain sha256 of data into digest
+inline void sha256_digest(const uint8_t *data, size_t data_sz, uint8_t *digest)
+{
+  SHA256_CTX ctx;
+  SHA256_Init(&ctx);
+  SHA256_Update(&ctx, data, data_sz);
+  SHA256_Final(digest, &ctx);
+}
+
+//the value of the hex char at index of the string sha256_to_str would make from digest
+inline uint32_t digest_nibble(const uint8_t *digest, uint32_t index)
+{
+  return (index & 1) ? (digest[index >> 1] & 0x0f) : (digest[index >> 1] >> 4);
+}
+
+//The same mix as mix_hashed_nums, but worked out on the raw digests. Only the
+// data that actually gets hashed is written out as hex, the index walk reads the
+// nibbles straight from the digest. Every mixed chunk is fed into mix_ctx as it
+// is made, followed by the unhashed data, so the mix is never stored.
+uint64 mix_hashed_digest(uint8_t *nums_digest, const uint8_t *unhashedData, size_t unhashed_sz,
+                         SHA256_CTX *mix_ctx)
+{
+  uint32_t index = 0, tmp_nibble;
+  const uint32_t hashed_nums_len = SHA256_LEN;
+
+  uint64 count;
+  uint8_t nums_str[SHA256_LEN], tmp_array[SHA256_LEN + 1], tmp_digest[DCRYPT_DIGEST_LENGTH];
+
+  //set the first hash length in the temp array to all 0xff
+  memset(tmp_array, 0xff, SHA256_LEN);
+
+  for(count = 0;; count++)
+  {
+    //+1 to keeps a 0 value of the nibble at index moving on
+    index += digest_nibble(nums_digest, index) + 1;
+
+    //if we hit the end of the hash, rehash its string
+    if(index >= hashed_nums_len)
+    {
+      index = index % hashed_nums_len;
+      sha256_digest_to_hex(nums_digest, nums_str);
+      sha256_digest(nums_str, hashed_nums_len, nums_digest); //rescramble
+    }
+
+    tmp_nibble = digest_nibble(nums_digest, index);
+
+    //plop the hex char at the end of tmp_array and hash it
+    tmp_array[SHA256_LEN] = hex_digits[tmp_nibble];
+    sha256_digest(tmp_array, SHA256_LEN + 1, tmp_digest);
+    sha256_digest_to_hex(tmp_digest, tmp_array);
+
+    SHA256_Update(mix_ctx, tmp_array, SHA256_LEN);
+
+    //check if the last value of hashed_nums is the same as the last value in tmp_array
+    if(index == hashed_nums_len - 1)
+      if(tmp_nibble == digest_nibble(tmp_digest, SHA256_LEN - 1))
+      {
+        count++;
+        break;
+      }
+  }
+
+  SHA256_Update(mix_ctx, unhashedData, unhashed_sz);
 
   return count * SHA256_LEN + unhashed_sz;
 }
 
-uint256 dcrypt(const uint8_t *data, size_t data_sz, uint8_t *hash_digest)
+//dcrypt is really intense, don't use it for testnet hashes,
+// it is too slow and takes more time to test, just use the traditional double sha256
+static uint256 dcrypt_testnet(const uint8_t *data, size_t data_sz)
+{
+  uint256 hash1, hash2;
+
+  sha256(data, data_sz, &hash1);
+  sha256((const u8int*)&hash1, sizeof(uint256), &hash2);
+
+  return hash2;
+}
+
+uint256 dcrypt(const uint8_t *data, size_t data_sz, uint64 *pnMixRounds)
 {
-  //dcrypt is really intense, don't use it for testnet hashes, 
-  // it is too slow and takes more time to test, just use the traditional double sha256
   if(fTestNet)
   {
-    uint256 hash1, hash2;
-
-    sha256(data, data_sz, &hash1);
-    sha256((const u8int*)&hash1, sizeof(uint256), &hash2);
+    if(pnMixRounds)
+      *pnMixRounds = 0;
 
-    return hash2;
+    return dcrypt_testnet(data, data_sz);
   }
-  
-  uint8_t hashed_nums[SHA256_LEN + 1], *mix_hash;
+
+  uint8_t nums_digest[DCRYPT_DIGEST_LENGTH];
   uint256 hash;
+  SHA256_CTX mix_ctx;
 
-  bool allocDigest = false;
-  if(!hash_digest)
+  sha256_digest(data, data_sz, nums_digest);
+
+  //mix the hashes up straight into the final hash, magority of the time takes here
+  SHA256_Init(&mix_ctx);
+  uint64 mix_hash_len = mix_hashed_digest(nums_digest, data, data_sz, &mix_ctx);
+  SHA256_Final((u8int*)&hash, &mix_ctx);
+
+  if(pnMixRounds)
+    *pnMixRounds = (mix_hash_len - data_sz) / SHA256_LEN;
+
+  //sucess
+  return hash;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/*                     Lockstep dcrypt over several inputs                  */
+//////////////////////////////////////////////////////////////////////////////
+
+//the second block of a sha256 over a 64 byte message is always the same padding
+static const uint8_t pad_after_64[64] = {
+  0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x00
+};
+
+inline void sha256_state_to_digest(const uint32_t *state, uint8_t *digest)
+{
+  for(int i = 0; i < 8; i++)
   {
-    hash_digest = (uint8_t*)malloc(DCRYPT_DIGEST_LENGTH);
-    allocDigest = true;
+    digest[i * 4]     = state[i] >> 24;
+    digest[i * 4 + 1] = state[i] >> 16;
+    digest[i * 4 + 2] = state[i] >> 8;
+    digest[i * 4 + 3] = state[i];
   }
+}
+
+//finishes a sha256 whose first prev_sz bytes, a multiple of 64, are already compressed into state
+static void sha256_finish(uint32_t *state, uint64 prev_sz, const uint8_t *data, size_t data_sz,
+                          uint8_t *digest)
+{
+  const uint64 nBits = (prev_sz + data_sz) * 8;
+  uint8_t block[64];
+
+  for(; data_sz >= 64; data += 64, data_sz -= 64)
+    sha256_transform(state, data);
+
+  memset(block, 0, sizeof(block));
+  memcpy(block, data, data_sz);
+  block[data_sz] = 0x80;
+
+  //no room for the length in this block
+  if(data_sz >= 56)
+  {
+    sha256_transform(state, block);
+    memset(block, 0, sizeof(block));
+  }
+
+  for(int i = 0; i < 8; i++)
+    block[63 - i] = nBits >> (i * 8);
+
+  sha256_transform(state, block);
+  sha256_state_to_digest(state, digest);
+}
+
+//Everything mix_hashed_digest keeps in locals, for one input being worked on in one lane
+typedef struct
+{
+  u32int nInput;      //index of the input this lane is hashing
+  uint32_t index, tmp_nibble, tmp_last_nibble;
+  uint64 count;
+  uint8_t nums_digest[DCRYPT_DIGEST_LENGTH];
+  uint8_t nums_str[SHA256_LEN];
+  uint8_t tmp_array[SHA256_LEN];
+  uint8_t tmp_tail[64];   //the char plopped at the end of tmp_array plus the padding
+  uint32_t mix_state[8];
+
+} Dcrypt_Lane;
+
+static void Dcrypt_Lane_start(Dcrypt_Lane *lane, u32int nInput, const uint8_t *data, size_t data_sz)
+{
+  lane->nInput = nInput;
+  lane->index = 0;
+  lane->count = 0;
+
+  sha256_digest(data, data_sz, lane->nums_digest);
+  memset(lane->tmp_array, 0xff, SHA256_LEN);
+
+  //a 65 byte message, 520 bits long
+  memset(lane->tmp_tail, 0, sizeof(lane->tmp_tail));
+  lane->tmp_tail[1] = 0x80;
+  lane->tmp_tail[62] = 0x02;
+  lane->tmp_tail[63] = 0x08;
+
+  memcpy(lane->mix_state, sha256_init_state, sizeof(lane->mix_state));
+}
+
+void dcrypt_multi(const uint8_t *const *pdata, size_t data_sz, uint256 *phashes, u32int nInputs,
+                  uint64 *pnMixRounds)
+{
+  const u32int nLanes = std::min(sha256_lanes(), nInputs);
+  uint64 nMixRounds = 0;
+
+  //nothing to gain from lanes, hash one at a time
+  if(fTestNet || nLanes <= 1)
+  {
+    for(u32int i = 0; i < nInputs; i++)
+    {
+      uint64 nRounds;
+      phashes[i] = dcrypt(pdata[i], data_sz, &nRounds);
+      nMixRounds += nRounds;
+    }
+
+    if(pnMixRounds)
+      *pnMixRounds = nMixRounds;
+
+    return;
+  }
+
+  Dcrypt_Lane lanes[SHA256_MAX_LANES];
+  Dcrypt_Lane *active[SHA256_MAX_LANES], *rehash[SHA256_MAX_LANES];
+  uint32_t states[SHA256_MAX_LANES][8];
+  const uint8_t *blocks[SHA256_MAX_LANES];
+  uint8_t tmp_digest[DCRYPT_DIGEST_LENGTH];
+  u32int i, nNext, nActive, nRehash;
+
+  for(nNext = 0; nNext < nLanes; nNext++)
+  {
+    Dcrypt_Lane_start(&lanes[nNext], nNext, pdata[nNext], data_sz);
+    active[nNext] = &lanes[nNext];
+  }
+
+  nActive = nLanes;
+  while(nActive)
+  {
+    //walk the index of every lane, the ones that ran off the end rehash together
+    nRehash = 0;
+    for(i = 0; i < nActive; i++)
+    {
+      Dcrypt_Lane *lane = active[i];
+      lane->index += digest_nibble(lane->nums_digest, lane->index) + 1;
+
+      if(lane->index >= SHA256_LEN)
+      {
+        lane->index = lane->index % SHA256_LEN;
+        sha256_digest_to_hex(lane->nums_digest, lane->nums_str);
+        rehash[nRehash++] = lane;
+      }
+    }
+
+    if(nRehash)
+    {
+      for(i = 0; i < nRehash; i++)
+      {
+        memcpy(states[i], sha256_init_state, sizeof(states[i]));
+        blocks[i] = rehash[i]->nums_str;
+      }
+      sha256_transform_lanes(states, blocks, nRehash);
+
+      for(i = 0; i < nRehash; i++)
+        blocks[i] = pad_after_64;
+      sha256_transform_lanes(states, blocks, nRehash);
+
+      for(i = 0; i < nRehash; i++)
+        sha256_state_to_digest(states[i], rehash[i]->nums_digest);
+    }
+
+    //hash tmp_array with its plopped char in every lane
+    for(i = 0; i < nActive; i++)
+    {
+      Dcrypt_Lane *lane = active[i];
+      lane->tmp_nibble = digest_nibble(lane->nums_digest, lane->index);
+      lane->tmp_tail[0] = hex_digits[lane->tmp_nibble];
+
+      memcpy(states[i], sha256_init_state, sizeof(states[i]));
+      blocks[i] = lane->tmp_array;
+    }
+    sha256_transform_lanes(states, blocks, nActive);
+
+    for(i = 0; i < nActive; i++)
+      blocks[i] = active[i]->tmp_tail;
+    sha256_transform_lanes(states, blocks, nActive);
+
+    //the new tmp_array goes into each lane's final hash
+    for(i = 0; i < nActive; i++)
+    {
+      sha256_state_to_digest(states[i], tmp_digest);
+      sha256_digest_to_hex(tmp_digest, active[i]->tmp_array);
+      active[i]->tmp_last_nibble = digest_nibble(tmp_digest, SHA256_LEN - 1);
+      active[i]->count++;
+
+      memcpy(states[i], active[i]->mix_state, sizeof(states[i]));
+      blocks[i] = active[i]->tmp_array;
+    }
+    sha256_transform_lanes(states, blocks, nActive);
+
+    //retire the lanes whose mix ended and hand them the next input
+    for(i = 0; i < nActive;)
+    {
+      Dcrypt_Lane *lane = active[i];
+      memcpy(lane->mix_state, states[i], sizeof(lane->mix_state));
+
+      if(lane->index != SHA256_LEN - 1 || lane->tmp_nibble != lane->tmp_last_nibble)
+      {
+        i++;
+        continue;
+      }
+
+      sha256_finish(lane->mix_state, lane->count * SHA256_LEN, pdata[lane->nInput], data_sz,
+                    (uint8_t*)&phashes[lane->nInput]);
+      nMixRounds += lane->count;
+
+      if(nNext < nInputs)
+      {
+        Dcrypt_Lane_start(lane, nNext, pdata[nNext], data_sz);
+        nNext++;
+        i++;
+      }else{
+        //keep the active lanes packed at the front, the moved lane's state moves with it
+        nActive--;
+        active[i] = active[nActive];
+        memcpy(states[i], states[nActive], sizeof(states[i]));
+      }
+    }
+  }
+
+  if(pnMixRounds)
+    *pnMixRounds = nMixRounds;
+}
+
+uint256 dcrypt_reference(const uint8_t *data, size_t data_sz)
+{
+  if(fTestNet)
+    return dcrypt_testnet(data, data_sz);
+  
+  uint8_t hashed_nums[SHA256_LEN + 1];
+  uint256 hash;
+
+  CDcryptScratch *pscratch = GetDcryptScratch();
+  uint8_t *hash_digest = pscratch->digest;
 
   sha256_to_str(data, data_sz, hashed_nums, hash_digest);
 
   //mix the hashes up, magority of the time takes here
-  uint64 mix_hash_len = mix_hashed_nums(hashed_nums, data, data_sz, &mix_hash, hash_digest);
+  uint64 mix_hash_len = mix_hashed_nums(hashed_nums, data, data_sz, pscratch->mix, hash_digest);
 
   //apply the final hash to the output
-  sha256((const uint8_t*)mix_hash, mix_hash_len, &hash);
-
-  free(mix_hash);
+  sha256((const uint8_t*)pscratch->mix.array, mix_hash_len, &hash);
 
-  if(allocDigest)
-    free(hash_digest);
+  pscratch->Trim();
 
   //sucess
   return hash;
@@ -9,7 +9,20 @@
 
 #define DCRYPT_DIGEST_LENGTH SHA256_DIGEST_LENGTH 
 
-//the dcrypt hashing algorithm for a single piece of data
-uint256 dcrypt(const uint8_t *data, size_t data_sz, uint8_t *hash_digest = 0);
+//the dcrypt hashing algorithm for a single piece of data, the mixed hashes are
+// streamed into the final sha256 so memory use does not depend on the mix length.
+// If pnMixRounds is given it is set to the number of rounds the mix loop ran
+uint256 dcrypt(const uint8_t *data, size_t data_sz, uint64 *pnMixRounds = 0);
+
+//dcrypt of nInputs pieces of data that are all data_sz long, hashes[i] is the dcrypt of
+// pdata[i]. The inputs are run side by side in the lanes of the multi-buffer sha256,
+// a lane whose mix ends early takes the next input straight away. If pnMixRounds is
+// given it is set to the mix rounds of all the inputs added together
+void dcrypt_multi(const uint8_t *const *pdata, size_t data_sz, uint256 *phashes, u32int nInputs,
+                  uint64 *pnMixRounds = 0);
+
+//dcrypt as originally written, the whole mix is built in a per-thread scratch
+// arena and hashed at the end. Kept as the reference the fast paths are tested against
+uint256 dcrypt_reference(const uint8_t *data, size_t data_sz);
 
 #endif
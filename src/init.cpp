@@ -200,6 +200,7 @@ bool AppInit2(int argc, char *argv[])
   }
 
   fUseFastIndex = GetBoolArg("-fastindex", true);
+  fBurnIndex = GetBoolArg("-burnindex");
 
   fTestNet = GetBoolArg("-testnet");
   if(fTestNet)
@@ -270,6 +271,7 @@ bool AppInit2(int argc, char *argv[])
   printf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
   printf("heat version %s (%s)\n", FormatFullVersion().c_str(), CLIENT_DATE.c_str());
   printf("Default data directory %s\n", GetDefaultDataDir().string().c_str());
+  printf("Dcrypt hashing %u lanes at a time\n", sha256_lanes_init(GetArg("-dcryptlanes", SHA256_LANES_AUTO)));
 
   if(GetBoolArg("-loadblockindextest"))
   {
@@ -322,6 +324,16 @@ bool AppInit2(int argc, char *argv[])
   }
   printf(" block index %15"PRI64d"ms\n", GetTimeMillis() - nStart);
 
+  if(fBurnIndex)
+  {
+    InitMessage(_("Updating burn index..."));
+    printf("Updating burn index...\n");
+    nStart = GetTimeMillis();
+    if(!UpdateBurnStatsIndex())
+      strErrors << _("Error updating the burn index") << "\n";
+    printf(" burn index  %15"PRI64d"ms\n", GetTimeMillis() - nStart);
+  }
+
   InitMessage(_("Loading wallet..."));
   printf("Loading wallet...\n");
   nStart = GetTimeMillis();
@@ -594,10 +606,13 @@ std::string HelpMessage()
       "  -pid=<file>      \t\t  " + _("Specify pid file (default: heatd.pid)") + "\n" +
       "  -gen             \t\t  " + _("Generate coins") + "\n" +
       "  -gen=0           \t\t  " + _("Don't generate coins") + "\n" +
+      "  -dcryptlanes=<n> \t\t  " + _("Hash up to <n> nonces side by side while mining, 1, 4, 8 or 16 (default: picked for this cpu)") + "\n" +
       "  -min             \t\t  " + _("Start minimized") + "\n" +
       "  -splash          \t\t  " + _("Show splash screen on startup (default: 1)") + "\n" +
       "  -datadir=<dir>   \t\t  " + _("Specify data directory") + "\n" +
       "  -dbcache=<n>     \t\t  " + _("Set database cache size in megabytes (default: 25)") + "\n" +
+      "  -blockcheckthreads=<n> \t  " + _("Check received blocks on <n> threads besides the message handler (default: one less than the cores)") + "\n" +
+      "  -scriptcheckthreads=<n> \t  " + _("Verify the scripts of a block on <n> threads besides the one connecting it (default: one less than the cores)") + "\n" +
       "  -dblogsize=<n>   \t\t  " + _("Set database disk log size in megabytes (default: 100)") + "\n" +
       "  -timeout=<n>     \t  "   + _("Specify connection timeout (in milliseconds)") + "\n" +
       "  -proxy=<ip:port> \t  "   + _("Connect through socks4 proxy") + "\n" +
@@ -642,13 +657,15 @@ std::string HelpMessage()
       "  -rpcpassword=<pw>\t  "   + _("Password for JSON-RPC connections") + "\n" +
       "  -rpcport=<port>  \t\t  " + _("Listen for JSON-RPC connections on <port> (default: 7829)") + "\n" +
       "  -rpcallowip=<ip> \t\t  " + _("Allow JSON-RPC connections from specified IP address") + "\n" +
+      "  -rpcthreads=<n>  \t\t  " + _("Handle at most <n> JSON-RPC connections at once (default: 16)") + "\n" +
       "  -rpcconnect=<ip> \t  "   + _("Send commands to node running on <ip> (default: 127.0.0.1)") + "\n" +
       "  -blocknotify=<cmd> "     + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n" +
       "  -upgradewallet   \t  "   + _("Upgrade wallet to latest format") + "\n" +
       "  -keypool=<n>     \t  "   + _("Set key pool size to <n> (default: 100)") + "\n" +
       "  -rescan          \t  "   + _("Rescan the block chain for missing wallet transactions") + "\n" +
       "  -checkblocks=<n> \t\t  " + _("How many blocks to check at startup (default: 2500, 0 = all)") + "\n" +
-      "  -checklevel=<n>  \t\t  " + _("How thorough the block verification is (0-6, default: 1)") + "\n";
+      "  -checklevel=<n>  \t\t  " + _("How thorough the block verification is (0-6, default: 1)") + "\n" +
+      "  -burnindex       \t  "   + _("Keep per block proof-of-burn statistics for getburnstats (default: 0)") + "\n";
 
     strUsage += string() +
       _("\nSSL options: (see the Bitcoin Wiki for SSL setup instructions)") + "\n" +
@@ -214,6 +214,25 @@ bool ComputeNextStakeModifier(const CBlockIndex *pindexPrev, uint64 &nStakeModif
   return true;
 }
 
+// Kernel stake modifiers already looked up, by the block of the coin generating the kernel.
+// The lookup walks the main chain forward from that block, so an entry holds for as long
+// as the block the walk ended on is still in the main chain, and only reorganizes past it
+// make it walk again
+struct CKernelModifier
+{
+  uint64 nStakeModifier;
+  int nStakeModifierHeight;
+  int64 nStakeModifierTime;
+  const CBlockIndex *pindexEnd;
+};
+
+// looked up modifiers kept, the oldest are dropped past that
+static const unsigned int MAX_KERNEL_MODIFIERS = 100000;
+
+static map<const CBlockIndex*, CKernelModifier> mapKernelModifiers;
+static std::deque<const CBlockIndex*> dequeKernelModifiers; //oldest first, for eviction
+static CCriticalSection cs_mapKernelModifiers;
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
 static bool GetKernelStakeModifier(const CBlockIndex *pindexFrom, uint64 &nStakeModifier, 
@@ -224,6 +243,23 @@ static bool GetKernelStakeModifier(const CBlockIndex *pindexFrom, uint64 &nStake
   if(!pindexFrom)
     return error("GetKernelStakeModifier() : pindexFrom is NULL");
 
+  {
+    LOCK(cs_mapKernelModifiers);
+    map<const CBlockIndex*, CKernelModifier>::iterator mi = mapKernelModifiers.find(pindexFrom);
+    if(mi != mapKernelModifiers.end())
+    {
+      const CKernelModifier &modifier = mi->second;
+      if(modifier.pindexEnd->IsInMainChain())
+      {
+        nStakeModifier = modifier.nStakeModifier;
+        nStakeModifierHeight = modifier.nStakeModifierHeight;
+        nStakeModifierTime = modifier.nStakeModifierTime;
+        return true;
+      }
+      //a reorganization passed pindexEnd, walk again and overwrite it below
+    }
+  }
+
   nStakeModifierHeight = pindexFrom->nHeight;
   nStakeModifierTime = pindexFrom->GetBlockTime();
   int64 nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
@@ -251,6 +287,25 @@ static bool GetKernelStakeModifier(const CBlockIndex *pindexFrom, uint64 &nStake
     }
   }
   nStakeModifier = pindex->nStakeModifier;
+
+  CKernelModifier modifier;
+  modifier.nStakeModifier = nStakeModifier;
+  modifier.nStakeModifierHeight = nStakeModifierHeight;
+  modifier.nStakeModifierTime = nStakeModifierTime;
+  modifier.pindexEnd = pindex;
+
+  LOCK(cs_mapKernelModifiers);
+  if(!mapKernelModifiers.count(pindexFrom))
+  {
+    dequeKernelModifiers.push_back(pindexFrom);
+    if(dequeKernelModifiers.size() > MAX_KERNEL_MODIFIERS)
+    {
+      mapKernelModifiers.erase(dequeKernelModifiers.front());
+      dequeKernelModifiers.pop_front();
+    }
+  }
+  mapKernelModifiers[pindexFrom] = modifier;
+
   return true;
 }
 
@@ -354,6 +409,68 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex *pindexFrom, uns
   return true;
 }
 
+bool ScanStakeKernelHash(unsigned int nBits, CStakeCandidate &candidate, unsigned int nTimeTx,
+                         unsigned int nSearch, unsigned int &nTimeTxRet, uint256 &hashProofOfStake)
+{
+  CBigNum bnTargetPerCoinDay;
+  bnTargetPerCoinDay.SetCompact(nBits);
+
+  // the kernel laid out as CheckStakeKernelHash() serializes it, only nTimeTx changes
+  // within the search, the modifier (or nBits for v0.2) goes in front when it is known
+  unsigned char pchKernel[sizeof(uint64) + 5 * sizeof(unsigned int)];
+  unsigned char *pchTail = pchKernel + sizeof(uint64);
+  memcpy(pchTail, &candidate.nTimeBlockFrom, sizeof(unsigned int));
+  memcpy(pchTail + 4, &candidate.nTxPrevOffset, sizeof(unsigned int));
+  memcpy(pchTail + 8, &candidate.nTimeTxPrev, sizeof(unsigned int));
+  memcpy(pchTail + 12, &candidate.nPrevout, sizeof(unsigned int));
+
+  for(unsigned int n = 0; n < nSearch; n++)
+  {
+    const unsigned int nTime = nTimeTx - n;
+
+    // earlier timestamps only fail these too
+    if(nTime < candidate.nTimeTxPrev || candidate.nTimeBlockFrom + nStakeMinAge > nTime)
+      return false;
+
+    const bool fV03 = IsProtocolV03(nTime);
+    unsigned char *pchBegin;
+    if(fV03)
+    {
+      // the modifier only changes with the chain it is walked along
+      if(candidate.pindexModifierBest != pindexBest)
+      {
+        int nStakeModifierHeight;
+        int64 nStakeModifierTime;
+        if(!GetKernelStakeModifier(candidate.pindexFrom, candidate.nStakeModifier, nStakeModifierHeight,
+                                   nStakeModifierTime, false))
+          return false;
+        candidate.pindexModifierBest = pindexBest;
+      }
+
+      pchBegin = pchKernel;
+      memcpy(pchBegin, &candidate.nStakeModifier, sizeof(uint64));
+    }else{
+      pchBegin = pchTail - sizeof(unsigned int);
+      memcpy(pchBegin, &nBits, sizeof(unsigned int));
+    }
+
+    memcpy(pchTail + 16, &nTime, sizeof(unsigned int));
+    hashProofOfStake = Hash(pchBegin, pchKernel + sizeof(pchKernel));
+
+    int64 nTimeWeight = min((int64)nTime - candidate.nTimeTxPrev, (int64)STAKE_MAX_AGE) - 
+      (fV03 ? nStakeMinAge : 0);
+    CBigNum bnCoinDayWeight = CBigNum(candidate.nValueIn) * nTimeWeight / COIN / (24 * 60 * 60);
+
+    if(CBigNum(hashProofOfStake) <= bnTargetPerCoinDay * bnCoinDayWeight)
+    {
+      nTimeTxRet = nTime;
+      return true;
+    }
+  }
+
+  return false;
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(const CTransaction &tx, unsigned int nBits, uint256 &hashProofOfStake)
 {
@@ -32,6 +32,12 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex *pindexFrom, uns
                           const CTransaction &txPrev, const COutPoint &prevout, unsigned int nTimeTx,
                           uint256 &hashProofOfStake, bool fPrintProofOfStake=false);
 
+// Search nSearch timestamps back from nTimeTx for a kernel meeting the hash target, hashing
+// the same as CheckStakeKernelHash() without touching the disk or allocating a stream
+// Sets nTimeTxRet and hashProofOfStake on success return
+bool ScanStakeKernelHash(unsigned int nBits, CStakeCandidate &candidate, unsigned int nTimeTx,
+                         unsigned int nSearch, unsigned int &nTimeTxRet, uint256 &hashProofOfStake);
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake);
@@ -121,6 +121,43 @@ err:
   return ret;
 }
 
+// heat: secp256k1 with the multiples of its generator worked out once. Every key
+// gets a copy of it that shares the table, so a signature check neither builds
+// the curve from its parameters nor multiplies the generator without a table.
+class CSecp256k1Group
+{
+public:
+  EC_GROUP *pgroup;
+
+  CSecp256k1Group()
+  {
+    pgroup = EC_GROUP_new_by_curve_name(NID_secp256k1);
+    if(pgroup && !EC_GROUP_precompute_mult(pgroup, NULL))
+      printf("CSecp256k1Group() : EC_GROUP_precompute_mult failed\n");
+  }
+
+  ~CSecp256k1Group()
+  {
+    if(pgroup)
+      EC_GROUP_free(pgroup);
+  }
+};
+
+static EC_KEY* NewSecp256k1Key()
+{
+  static CSecp256k1Group secp256k1;
+  if(!secp256k1.pgroup)
+    return EC_KEY_new_by_curve_name(NID_secp256k1);
+
+  EC_KEY *pkey = EC_KEY_new();
+  if(pkey && !EC_KEY_set_group(pkey, secp256k1.pgroup))
+  {
+    EC_KEY_free(pkey);
+    return NULL;
+  }
+  return pkey;
+}
+
 void CKey::SetCompressedPubKey()
 {
   EC_KEY_set_conv_form(pkey, POINT_CONVERSION_COMPRESSED);
@@ -130,9 +167,9 @@ void CKey::SetCompressedPubKey()
 void CKey::Reset()
 {
   fCompressedPubKey = false;
-  pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+  pkey = NewSecp256k1Key();
   if(pkey == NULL)
-    throw key_error("CKey::CKey() : EC_KEY_new_by_curve_name failed");
+    throw key_error("CKey::CKey() : NewSecp256k1Key failed");
   fSet = false;
 }
 
@@ -193,9 +230,9 @@ bool CKey::SetPrivKey(const CPrivKey& vchPrivKey)
 bool CKey::SetSecret(const CSecret& vchSecret, bool fCompressed)
 {
   EC_KEY_free(pkey);
-  pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+  pkey = NewSecp256k1Key();
   if(pkey == NULL)
-    throw key_error("CKey::SetSecret() : EC_KEY_new_by_curve_name failed");
+    throw key_error("CKey::SetSecret() : NewSecp256k1Key failed");
   if(vchSecret.size() != 32)
     throw key_error("CKey::SetSecret() : secret must be 32 bytes");
   BIGNUM *bn = BN_bin2bn(&vchSecret[0],32,BN_new());
@@ -335,7 +372,7 @@ bool CKey::SetCompactSignature(uint256 hash, const std::vector<unsigned char>& v
   BN_bin2bn(&vchSig[33],32,sig->s);
 
   EC_KEY_free(pkey);
-  pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+  pkey = NewSecp256k1Key();
   if(nV >= 31)
   {
     SetCompressedPubKey();
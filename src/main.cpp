@@ -18,6 +18,7 @@
 #include <cstdlib>      /* std::rand() */
 
 #include "dcrypt.h"
+#include "workqueue.h"
 
 using namespace std;
 using namespace boost;
@@ -51,6 +52,11 @@ CBigNum bnBestInvalidTrust = 0;
 uint256 hashBestChain = 0;
 CBlockIndex *pindexBest = NULL;
 int64 nTimeBestReceived = 0;
+bool fBurnIndex = false;
+
+//the best chain's block index at every height, see pindexByHeight()
+static std::vector<CBlockIndex*> vBestChainByHeight;
+static CCriticalSection cs_vBestChainByHeight;
 
 ////////////////////////////////
 //PATCHES
@@ -103,12 +109,20 @@ const string strMessageMagic = "SLIMCoin Signed Message:\n";
 
 double dHashesPerSec;
 int64 nHPSTimerStart;
+CMinerThreadStats vMinerThreadStats[MAX_MINER_STATS_THREADS];
+volatile unsigned int nMinerTemplatesBuilt = 0;
+volatile int64 nMinerTemplateTime = 0;
 
 // Settings
 int64 nTransactionFee = MIN_TX_FEE;
 
 // Dcrypt hash scanner
-static u32int ScanDcryptHash(CBlock *pblock, u32int *nHashesDone, uint256 *phash);
+#define DCRYPT_SCAN_BATCH  (SHA256_MAX_LANES * 16) //nonces handed to dcrypt_multi at a time
+static u32int ScanDcryptHash(CBlock *pblock, u32int *nHashesDone, uint256 *phash, const volatile bool *pfAbort = NULL,
+                             uint64 *pnMixRounds = NULL);
+
+// Shared proof-of-work template, see heatMiner
+static void MinerTipChanged();
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -1181,52 +1195,54 @@ static u32int GetNextTargetRequired(const CBlockIndex *pindexLast, bool fProofOf
   return bnNew.GetCompact();
 }
 
-static u32int GetNextBurnTargetRequired(const CBlockIndex *pindexLast)
+//the new protocol's burn target once there are nPoW PoW blocks after the last PoB block pindex
+static u32int GetBurnTargetAfterPoW(const CBlockIndex *pindex, u32int nPoW)
 {
-  //new protocol has a target PoW blocks between each PoB block
-  if(fTestNet || pindexLast->nTime > POB_POS_TARGET_SWITCH_TIME)
-  {
-    const CBigNum bnTargetLimit = bnProofOfBurnLimit;
+  const CBigNum bnTargetLimit = bnProofOfBurnLimit;
 
-    if(pindexLast == NULL)
-      return bnTargetLimit.GetCompact(); // genesis block
+  //if pindex is NULL, that means that there were no PoB blocks found and it got to the genesis block
+  if(!pindex)
+    return bnTargetLimit.GetCompact();
 
-    //go backwards and find the last PoB block in the blockchain
-    // once it exits, pindex is the last PoB block in the blockchain
-    // and nPoW is the number of PoW blocks between pindexLast (inclusive) and the final pindex
-    u32int nPoW = 0;
-    const CBlockIndex *pindex = pindexLast;
-    for(; pindex && !pindex->IsProofOfBurn(); pindex = pindex->pprev)
-      if(pindex->IsProofOfWork())
-        nPoW++;
+  // heat: target change every block
+  // heat: retarget with exponential moving toward target spacing
 
-    //if pindex is NULL, that means that there were no PoB blocks found and it got to the genesis block
-    if(!pindex)
-      return bnTargetLimit.GetCompact();
+  //use the last PoB block's target as a seed
+  CBigNum bnNew;
+  bnNew.SetCompact(pindex->nBurnBits);
 
-    //if there were no PoW blocks between, return the pindexLast's nBurnBits
-    if(!nPoW)
-      return pindexLast->nBurnBits;
+  //target spacing is 3 PoW blocks inbetween each PoB block
+  const int64 nTargetSpacing = POB_TARGET_SPACING;
+  const int64 nInterval = nPoBTargetTimespan / nTargetSpacing;
+
+  bnNew *= ((nInterval - 1) * nTargetSpacing + nPoW + nPoW);
+  bnNew /= ((nInterval + 1) * nTargetSpacing);
 
-    // heat: target change every block
-    // heat: retarget with exponential moving toward target spacing
+  //we can't make it too easy
+  if(bnNew > bnTargetLimit)
+    bnNew = bnTargetLimit;
 
-    //use the last PoB block's target as a seed
-    CBigNum bnNew;
-    bnNew.SetCompact(pindex->nBurnBits);
+  return bnNew.GetCompact();
+}
 
-    //target spacing is 3 PoW blocks inbetween each PoB block
-    const int64 nTargetSpacing = POB_TARGET_SPACING;
-    const int64 nInterval = nPoBTargetTimespan / nTargetSpacing;
+static u32int GetNextBurnTargetRequired(const CBlockIndex *pindexLast)
+{
+  //new protocol has a target PoW blocks between each PoB block
+  if(fTestNet || pindexLast->nTime > POB_POS_TARGET_SWITCH_TIME)
+  {
+    if(pindexLast == NULL)
+      return bnProofOfBurnLimit.GetCompact(); // genesis block
 
-    bnNew *= ((nInterval - 1) * nTargetSpacing + nPoW + nPoW);
-    bnNew /= ((nInterval + 1) * nTargetSpacing);
+    //pindex is the last PoB block in the blockchain and nPoW is the number of
+    // PoW blocks between pindexLast (inclusive) and pindex, both kept in the index
+    const CBlockIndex *pindex = pindexLast->pindexLastPoB;
+    const u32int nPoW = pindexLast->nPoWSinceLastPoB;
 
-    //we can't make it too easy
-    if(bnNew > bnTargetLimit)
-      bnNew = bnTargetLimit;
+    //if there were no PoW blocks between, return the pindexLast's nBurnBits
+    if(pindex && !nPoW)
+      return pindexLast->nBurnBits;
 
-    return bnNew.GetCompact();    
+    return GetBurnTargetAfterPoW(pindex, nPoW);
 
   }else{  //old prototcol is based off of nEffective burnt coins
     
@@ -1315,8 +1331,8 @@ bool CBlock::CheckProofOfBurn() const
 
   //failure to read a burn block may occur durring the initial block download
   CBlock burnBlock;
-  //Read the block
-  if(!burnBlock.ReadFromDisk(pBurnIndex))
+  //Read the block, unless its burn transaction was read for the same burn hash before
+  if(!IsBurnHashCached(hashPrevBlock, burnBlkHeight, burnCTx, burnCTxOut) && !burnBlock.ReadFromDisk(pBurnIndex))
     return DoS(1, error("CheckProofOfBurn() : INFO: prev block cannot be read"));
 
   //the previous block must be a PoW block
@@ -1561,7 +1577,8 @@ unsigned int CTransaction::GetP2SHSigOpCount(const MapPrevTx& inputs) const
 bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                                  map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
                                  const CBlockIndex* pindexBlock, bool fBlock, 
-                                 bool fMiner, bool fStrictPayToScriptHash)
+                                 bool fMiner, bool fStrictPayToScriptHash,
+                                 vector<CScriptCheck> *pvChecks)
 {
   // Take over previous transactions' spent pointers
   // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -1618,8 +1635,15 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
       // still computed and checked, and any change will be caught at the next checkpoint.
       if(!(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
       {
+        // heat: leave the script to the caller, only the cheap part of VerifySignature() is done here
+        if(pvChecks)
+        {
+          if(prevout.hash != txPrev.GetHash())
+            return DoS(100,error("ConnectInputs() : %s VerifySignature failed", GetHash().ToString().substr(0,10).c_str()));
+          pvChecks->push_back(CScriptCheck(txPrev.vout[prevout.n], *this, i, fStrictPayToScriptHash));
+        }
         // Verify signature
-        if(!VerifySignature(txPrev, *this, i, fStrictPayToScriptHash, 0))
+        else if(!VerifySignature(txPrev, *this, i, fStrictPayToScriptHash, 0))
         {
           // only during transition phase for P2SH: do not invoke anti-DoS code for
           // potentially old clients relaying bad P2SH transactions
@@ -1721,6 +1745,116 @@ bool CTransaction::ClientConnectInputs()
 
 
 
+//writes the block's -burnindex record, following on from its parent's
+static bool WriteBlockBurnStats(CTxDB &txdb, const CBlock &block, const CBlockIndex *pindex)
+{
+  CBurnStats statsPrev;
+  if(pindex->pprev && (!txdb.ReadBurnStats(pindex->nHeight - 1, statsPrev) ||
+                       statsPrev.hashBlock != pindex->pprev->GetBlockHash()))
+    return false;
+
+  CBurnStats stats;
+  stats.hashBlock = pindex->GetBlockHash();
+
+  BOOST_FOREACH(const CTransaction &tx, block.vtx)
+  {
+    s32int burnOutTxIndex = tx.GetBurnOutTxIndex();
+    if(burnOutTxIndex != -1) //this is a burn transaction
+      stats.nBurnedCoins += tx.vout[burnOutTxIndex].nValue;
+  }
+
+  stats.nTotalBurnedCoins = statsPrev.nTotalBurnedCoins + stats.nBurnedCoins;
+  stats.nEffectiveBurnCoins = block.nEffectiveBurnCoins;
+  stats.nBurnBits = block.nBurnBits;
+
+  if(block.IsProofOfBurn())
+  {
+    stats.burnBlkHeight = block.burnBlkHeight;
+    stats.burnCTx = block.burnCTx;
+    stats.burnCTxOut = block.burnCTxOut;
+    stats.burnHash = block.burnHash;
+  }
+
+  return txdb.WriteBurnStats(pindex->nHeight, stats) && txdb.WriteBurnStatsBest(stats.hashBlock);
+}
+
+//writes the records missing up to pindexLast, back to the last one matching its
+// branch, inside the caller's db transaction
+static bool WriteBurnStatsGap(CTxDB &txdb, const CBlockIndex *pindexLast)
+{
+  vector<const CBlockIndex*> vGap;
+  for(const CBlockIndex *pindex = pindexLast; pindex; pindex = pindex->pprev)
+  {
+    CBurnStats stats;
+    if(txdb.ReadBurnStats(pindex->nHeight, stats) && stats.hashBlock == pindex->GetBlockHash())
+      break;
+    vGap.push_back(pindex);
+  }
+
+  BOOST_REVERSE_FOREACH(const CBlockIndex *pindex, vGap)
+  {
+    CBlock block;
+    if(!block.ReadFromDisk(pindex) || !WriteBlockBurnStats(txdb, block, pindex))
+      return error("WriteBurnStatsGap() : failed at height %d", pindex->nHeight);
+  }
+
+  if(!vGap.empty())
+    printf("WriteBurnStatsGap() : %d blocks caught up\n", (int)vGap.size());
+  return true;
+}
+
+bool UpdateBurnStatsIndex()
+{
+  LOCK(cs_main);
+  CTxDB txdb;
+
+  //carry on from the last block written, or from where its branch left the main chain
+  CBlockIndex *pindex = NULL;
+  int nHeightWritten = -1;
+  uint256 hashWritten;
+  if(txdb.ReadBurnStatsBest(hashWritten))
+  {
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashWritten);
+    if(mi != mapBlockIndex.end())
+    {
+      nHeightWritten = mi->second->nHeight;
+      for(pindex = mi->second; pindex && !pindex->IsInMainChain(); pindex = pindex->pprev) ;
+    }
+  }
+  pindex = pindex ? pindex->pnext : pindexGenesisBlock;
+
+  int nBlocks = 0;
+  if(!txdb.TxnBegin())
+    return error("UpdateBurnStatsIndex() : TxnBegin failed");
+
+  for(; pindex && !fRequestShutdown; pindex = pindex->pnext)
+  {
+    CBlock block;
+    if(!block.ReadFromDisk(pindex) || !WriteBlockBurnStats(txdb, block, pindex))
+    {
+      txdb.TxnAbort();
+      return error("UpdateBurnStatsIndex() : failed at height %d", pindex->nHeight);
+    }
+
+    //commit every so often so the transaction does not grow with the whole chain
+    if(++nBlocks % 1000 == 0 && (!txdb.TxnCommit() || !txdb.TxnBegin()))
+    {
+      txdb.TxnAbort();
+      return error("UpdateBurnStatsIndex() : TxnCommit failed");
+    }
+  }
+
+  //a longer branch written before may have left records past the best height
+  for(int nHeight = nBestHeight + 1; nHeight <= nHeightWritten; nHeight++)
+    txdb.EraseBurnStats(nHeight);
+
+  if(!txdb.TxnCommit())
+    return error("UpdateBurnStatsIndex() : TxnCommit failed");
+
+  printf("UpdateBurnStatsIndex() : %d blocks added\n", nBlocks);
+  return true;
+}
+
 bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 {
   // Disconnect in reverse order
@@ -1738,6 +1872,17 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
       return error("DisconnectBlock() : WriteBlockIndex failed");
   }
 
+  // heat: -burnindex, the height is written again if the new branch reaches it
+  if(fBurnIndex && pindex->pprev)
+  {
+    CBurnStats stats;
+    if(txdb.ReadBurnStats(pindex->nHeight, stats) && stats.hashBlock == pindex->GetBlockHash())
+    {
+      if(!txdb.EraseBurnStats(pindex->nHeight) || !txdb.WriteBurnStatsBest(pindex->pprev->GetBlockHash()))
+        return error("DisconnectBlock() : burn index update failed");
+    }
+  }
+
   // heat: clean up wallet after disconnecting coinstake
   BOOST_FOREACH(CTransaction& tx, vtx)
     SyncWithWallets(tx, this, false, false);
@@ -1745,6 +1890,77 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
   return true;
 }
 
+//Script checks are most of what ConnectBlock() spends its time on. While it
+// fetches the inputs of a transaction and queues up what it spends, the script
+// checks of the transactions before it run on a pool of threads. Nothing is
+// written for the block until every one of them has passed.
+
+static CWorkQueue scriptCheckQueue("ThreadScriptCheck");
+
+void CScriptCheckRange::Run()
+{
+  BOOST_FOREACH(const CScriptCheck &check, vChecks)
+  {
+    nChecked++;
+    pcheckFailed = &check; //stays set if the check throws
+    if(!check.Verify())
+    {
+      fP2SHFailure = check.fStrictPayToScriptHash && check.Verify(false);
+      return;
+    }
+  }
+  pcheckFailed = NULL;
+}
+
+void CScriptCheckRanges::Push()
+{
+  listRanges.push_back(CScriptCheckRange());
+  listRanges.back().vChecks.swap(vPending);
+  scriptCheckQueue.Push(&listRanges.back());
+}
+
+CScriptCheckRanges::~CScriptCheckRanges()
+{
+  BOOST_FOREACH(CScriptCheckRange &range, listRanges)
+    scriptCheckQueue.Wait(&range);
+}
+
+void CScriptCheckRanges::Add(vector<CScriptCheck> &vChecks)
+{
+  vPending.insert(vPending.end(), vChecks.begin(), vChecks.end());
+  vChecks.clear();
+  if(vPending.size() >= SCRIPT_CHECK_CHUNK)
+    Push();
+}
+
+const CScriptCheckRange* CScriptCheckRanges::Wait()
+{
+  if(!vPending.empty())
+    Push();
+
+  const CScriptCheckRange *prangeFailed = NULL;
+  BOOST_FOREACH(CScriptCheckRange &range, listRanges)
+  {
+    scriptCheckQueue.Wait(&range);
+    if(!prangeFailed && range.pcheckFailed)
+      prangeFailed = &range;
+  }
+  return prangeFailed;
+}
+
+void StartScriptCheckThreads()
+{
+  //the thread connecting the block runs checks too while it waits on them
+  int nThreads = GetArg("-scriptcheckthreads", (int)boost::thread::hardware_concurrency() - 1);
+  if(nThreads > 0)
+    printf("Started %d script check threads\n", scriptCheckQueue.Start(nThreads));
+}
+
+void StopScriptCheckThreads()
+{
+  scriptCheckQueue.Stop();
+}
+
 bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 {
   // Check it again in case a previous version let a bad block in
@@ -1781,12 +1997,20 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 
   //// issue here: it doesn't know the version
   unsigned int nTxPos = pindex->nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(vtx.size());
+  vector<unsigned int> vTxPos;
+  vTxPos.reserve(vtx.size());
 
   map<uint256, CTxIndex> mapQueuedChanges;
   int64 nFees = 0;
   int64 nValueIn = 0;
   int64 nValueOut = 0;
   unsigned int nSigOps = 0;
+
+  //without script check threads they are run inside ConnectInputs() as they come
+  CScriptCheckRanges scriptChecks;
+  vector<CScriptCheck> vChecks;
+  vector<CScriptCheck> *pvChecks = scriptCheckQueue.GetThreads() > 0 ? &vChecks : NULL;
+
   BOOST_FOREACH(CTransaction& tx, vtx)
   {
     nSigOps += tx.GetLegacySigOpCount();
@@ -1794,6 +2018,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
       return DoS(100, error("ConnectBlock() : too many sigops"));
 
     CDiskTxPos posThisTx(pindex->nFile, pindex->nBlockPos, nTxPos);
+    vTxPos.push_back(nTxPos);
     nTxPos += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
 
     MapPrevTx mapInputs;
@@ -1822,18 +2047,42 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
       if(!tx.IsCoinStake())
         nFees += nTxValueIn - nTxValueOut;
 
-      if(!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, fStrictPayToScriptHash))
+      if(!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, fStrictPayToScriptHash, pvChecks))
         return false;
+      if(pvChecks)
+        scriptChecks.Add(vChecks);
     }
 
     mapQueuedChanges[tx.GetHash()] = CTxIndex(posThisTx, tx.vout.size());
   }
 
+  // Every script check has to pass before anything of the block is written
+  const CScriptCheckRange *prangeFailed = scriptChecks.Wait();
+  if(prangeFailed)
+  {
+    const CTransaction &txFailed = *prangeFailed->pcheckFailed->ptxTo;
+
+    // only during transition phase for P2SH: do not invoke anti-DoS code for
+    // potentially old clients relaying bad P2SH transactions
+    if(prangeFailed->fP2SHFailure)
+      return error("ConnectBlock() : %s P2SH VerifySignature failed", txFailed.GetHash().ToString().substr(0,10).c_str());
+
+    return DoS(100, error("ConnectBlock() : %s VerifySignature failed", txFailed.GetHash().ToString().substr(0,10).c_str()));
+  }
+
   // heat: track money supply and mint amount info
   pindex->nMint = nValueOut - nValueIn + nFees;
   pindex->nMoneySupply = (pindex->pprev? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
   if(!txdb.WriteBlockIndex(CDiskBlockIndex(pindex)))
     return error("Connect() : WriteBlockIndex for pindex failed");
+  if(!txdb.WriteBlockTxPos(pindex->GetBlockHash(), vTxPos))
+    return error("ConnectBlock() : WriteBlockTxPos failed");
+
+  // heat: -burnindex, a parent without a record has the gap below it filled in first, a
+  // failure there leaves the block valid and the gap for the next block to fill
+  if(fBurnIndex && !WriteBlockBurnStats(txdb, *this, pindex) &&
+     (!WriteBurnStatsGap(txdb, pindex->pprev) || !WriteBlockBurnStats(txdb, *this, pindex)))
+    error("ConnectBlock() : burn index record for height %d not written", pindex->nHeight);
 
   // Write queued txindex changes
   for(map<uint256, CTxIndex>::iterator mi = mapQueuedChanges.begin(); mi != mapQueuedChanges.end(); ++mi)
@@ -2069,11 +2318,14 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
 
   // New best block
   hashBestChain = hash;
+  SetBestChainByHeight(pindexNew);
   pindexBest = pindexNew;
   nBestHeight = pindexBest->nHeight;
   bnBestChainTrust = pindexNew->bnChainTrust;
   nTimeBestReceived = GetTime();
   nTransactionsUpdated++;
+  MinerTipChanged();
+  NotifyTipChanged();
   printf("SetBestChain: new best=%s  height=%d  trust=%s  moneysupply=%s nEffectiveBurnCoins=%s\n", 
          hashBestChain.ToString().substr(0,20).c_str(), nBestHeight, bnBestChainTrust.ToString().c_str(), 
          FormatMoney(pindexBest->nMoneySupply).c_str(), FormatMoney(pindexBest->nEffectiveBurnCoins).c_str());
@@ -2193,6 +2445,7 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos)
 
   // heat: compute chain trust score
   pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
+  pindexNew->SetChainCounts();
 
   // heat: compute stake entropy bit for stake modifier
   if(!pindexNew->SetStakeEntropyBit(GetStakeEntropyBit()))
@@ -2565,8 +2818,8 @@ bool ProcessBlock(CNode *pfrom, CBlock *pblock)
                  pblock->GetProofOfBurn().second.ToString().c_str(), 
                  hash.ToString().c_str());
 
-  // Preliminary checks
-  if(!pblock->CheckBlock())
+  // Preliminary checks, blocks off the network have usually passed them on a block check thread
+  if(!pblock->fChecked && !pblock->CheckBlock())
     return error("ProcessBlock() : CheckBlock FAILED");
 
   // heat: verify hash target and signature of coinstake tx
@@ -3297,7 +3550,7 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
 
 
 
-bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
+bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, CBlock *pblockChecked = NULL)
 {
   static map<CService, vector<unsigned char> > mapReuseKey;
   RandAddSeedPerfmon();
@@ -3792,8 +4045,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
   else if(strCommand == "block")
   {
-    CBlock block;
-    vRecv >> block;
+    //the block check threads may have already read and checked it
+    CBlock blockRecv;
+    CBlock &block = (pblockChecked ? *pblockChecked : blockRecv);
+    if(!pblockChecked)
+      vRecv >> block;
 
     const uint256 blockHash = block.GetHash();
     printf("received block %s\n", blockHash.ToString().substr(0, 20).c_str());
@@ -3936,6 +4192,93 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
   return true;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// Block checks
+//
+
+//Dcrypt makes the proof-of-work check the bulk of CheckBlock(), which would pin
+// a sync to the one core the message handler runs on. So blocks waiting in a
+// node's receive buffer are read and checked on a pool of threads first, then
+// handed to ProcessMessage in the order they arrived.
+
+static CWorkQueue blockCheckQueue("ThreadBlockCheck");
+
+class CBlockCheck : public CWorkItem
+{
+public:
+  CBlock block;
+  uint256 hashMsg; //message checksum hash, to match it back up with its message
+
+  void Run()
+  {
+    //CheckBlock() fills in the block's hash cache on the way
+    if(block.CheckBlock())
+      block.fChecked = true;
+    else
+      block.nDoS = 0; //ProcessBlock will run it again and punish the node then
+  }
+};
+
+void StartBlockCheckThreads()
+{
+  //the message handler runs checks too while it waits on them
+  int nThreads = GetArg("-blockcheckthreads", (int)boost::thread::hardware_concurrency() - 1);
+  if(nThreads > 0)
+    printf("Started %d block check threads\n", blockCheckQueue.Start(nThreads));
+}
+
+void StopBlockCheckThreads()
+{
+  blockCheckQueue.Stop();
+}
+
+//queues every complete block message in the node's receive buffer, mirrors
+// the message parsing in ProcessMessages without consuming anything
+static void QueueBlockChecks(CNode* pfrom, deque<CBlockCheck*> &queueChecks)
+{
+  CDataStream& vRecv = pfrom->vRecv;
+  unsigned char pchMessageStart[4];
+  GetMessageStart(pchMessageStart);
+  int nHeaderSize = vRecv.GetSerializeSize(CMessageHeader());
+
+  CDataStream::iterator pstart = vRecv.begin();
+  for(;;)
+  {
+    pstart = search(pstart, vRecv.end(), BEGIN(pchMessageStart), END(pchMessageStart));
+    if(vRecv.end() - pstart < nHeaderSize)
+      break;
+
+    CMessageHeader hdr;
+    CDataStream(pstart, pstart + nHeaderSize, vRecv.nType, vRecv.nVersion) >> hdr;
+    pstart += nHeaderSize;
+
+    if(!hdr.IsValid() || hdr.nMessageSize > MAX_SIZE)
+      continue;
+    if(hdr.nMessageSize > (unsigned int)(vRecv.end() - pstart))
+      break;
+
+    CDataStream::iterator pend = pstart + hdr.nMessageSize;
+    if(hdr.GetCommand() == "block")
+    {
+      CBlockCheck *pcheck = new CBlockCheck();
+      pcheck->hashMsg = Hash(pstart, pend);
+
+      try
+      {
+        CDataStream(pstart, pend, vRecv.nType, vRecv.nVersion) >> pcheck->block;
+        blockCheckQueue.Push(pcheck);
+        queueChecks.push_back(pcheck);
+      }
+      catch (std::exception& e) {
+        //leave it to ProcessMessage to complain about
+        delete pcheck;
+      }
+    }
+    pstart = pend;
+  }
+}
+
 bool ProcessMessages(CNode* pfrom)
 {
   CDataStream& vRecv = pfrom->vRecv;
@@ -3964,6 +4307,10 @@ bool ProcessMessages(CNode* pfrom)
     nTimeLastPrintMessageStart = GetAdjustedTime();
   }
 
+  deque<CBlockCheck*> queueChecks;
+  if(blockCheckQueue.GetThreads() > 0)
+    QueueBlockChecks(pfrom, queueChecks);
+
   for(;;)
   {
     // Scan for message start
@@ -4022,16 +4369,29 @@ bool ProcessMessages(CNode* pfrom)
     CDataStream vMsg(vRecv.begin(), vRecv.begin() + nMessageSize, vRecv.nType, vRecv.nVersion);
     vRecv.ignore(nMessageSize);
 
+    // Pick up the block's checks, outside of cs_main
+    CBlockCheck *pcheck = NULL;
+    if(strCommand == "block")
+    {
+      while(!queueChecks.empty() && !pcheck)
+      {
+        blockCheckQueue.Wait(queueChecks.front());
+        if(queueChecks.front()->hashMsg == hash)
+          pcheck = queueChecks.front();
+        else
+          delete queueChecks.front();
+        queueChecks.pop_front();
+      }
+    }
+
     // Process message
     bool fRet = false;
     try
     {
       {
         LOCK(cs_main);
-        fRet = ProcessMessage(pfrom, strCommand, vMsg);
+        fRet = ProcessMessage(pfrom, strCommand, vMsg, pcheck ? &pcheck->block : NULL);
       }
-      if(fShutdown)
-        return true;
     }
     catch (std::ios_base::failure& e)
     {
@@ -4056,10 +4416,21 @@ bool ProcessMessages(CNode* pfrom)
       PrintExceptionContinue(NULL, "ProcessMessages()");
     }
 
+    delete pcheck;
+    if(fShutdown)
+      break;
+
     if(!fRet)
       printf("ProcessMessage(%s, %u bytes) FAILED\n", strCommand.c_str(), nMessageSize);
   }
 
+  // Anything still queued belongs to messages that were not processed
+  BOOST_FOREACH(CBlockCheck *pcheck, queueChecks)
+  {
+    blockCheckQueue.Wait(pcheck);
+    delete pcheck;
+  }
+
   vRecv.Compact();
   return true;
 }
@@ -4281,80 +4652,109 @@ void SHA256Transform(void* pstate, void* pinput, const void* pinit)
 }
 
 //
-// ScanDcryptHash scans nonces looking for a hash with at least some zero bits.
+// ScanDcryptHash scans nonces looking for a hash that meets the block's target.
 // It operates on big endian data.  Caller does the byte reversing.
 // nNonce is usually preserved between calls, but periodically or if nNonce is 0xffff0000 or above,
 // the block is rebuilt and nNonce starts over at zero.
+// The scan also gives up between batches once *pfAbort is set, pnMixRounds adds up the dcrypt
+// mix rounds of every hash done.
 //
-static u32int ScanDcryptHash(CBlock *pblock, u32int *nHashesDone, uint256 *phash)
+static u32int ScanDcryptHash(CBlock *pblock, u32int *nHashesDone, uint256 *phash, const volatile bool *pfAbort,
+                             uint64 *pnMixRounds)
 {
   u32int *nNonce = &(pblock->nNonce);
   u32int orig_nNonce = *nNonce;
-  uint8_t digest[DCRYPT_DIGEST_LENGTH];
 
-  for(; !fShutdown;)
+  //checked here rather than by the caller, returning early on a weaker hash would
+  // throw away the rest of the batch
+  const uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+
+  //the nonces of a batch are hashed side by side by dcrypt_multi, one header copy each
+  const u32int nHeaderSize = HASH_PBLOCK_SIZE(pblock);
+  const u32int nNonceOffset = UBEGIN(pblock->nNonce) - UBEGIN(pblock->nVersion);
+  u8int headers[DCRYPT_SCAN_BATCH][HASH_HEADER_SIZE];
+  const u8int *pheaders[DCRYPT_SCAN_BATCH];
+  uint256 hashes[DCRYPT_SCAN_BATCH];
+
+  assert(nHeaderSize == HASH_HEADER_SIZE);
+  for(u32int i = 0; i < DCRYPT_SCAN_BATCH; i++)
   {
-    //hash the block
-    (*nNonce)++;
+    memcpy(headers[i], UBEGIN(pblock->nVersion), nHeaderSize);
+    pheaders[i] = headers[i];
+  }
 
-    *phash = dcrypt(UBEGIN(pblock->nVersion), HASH_PBLOCK_SIZE(pblock), digest);
+  for(; !fShutdown && !(pfAbort && *pfAbort);)
+  {
+    //never run a batch past the next multiple of 0x10000, that is where we give up
+    u32int nBatch = std::min((u32int)DCRYPT_SCAN_BATCH, 0x10000 - (*nNonce & 0xffff));
 
-    // Return the nonce if the top 8 bits of the hash are all 0s,
-    // caller will check if it satisfies the target
-    if(!uint256_get_top<u8int>(*phash))
+    for(u32int i = 0; i < nBatch; i++)
     {
-      //increment the hash counter accordingly
-      *nHashesDone += (*nNonce - orig_nNonce);
-      return *nNonce;
+      u32int nBatchNonce = *nNonce + i + 1;
+      memcpy(headers[i] + nNonceOffset, &nBatchNonce, sizeof(nBatchNonce));
     }
 
-    // If nothing found after trying for a while, return -1
-    if(!(*nNonce & 0xffff))
+    //hash the block
+    uint64 nBatchMixRounds;
+    dcrypt_multi(pheaders, nHeaderSize, hashes, nBatch, &nBatchMixRounds);
+    if(pnMixRounds)
+      *pnMixRounds += nBatchMixRounds;
+
+    for(u32int i = 0; i < nBatch; i++)
     {
-      *nHashesDone = 0xffff + 1;
-      return (u32int) -1;
+      // Return the nonce if the hash meets the target
+      if(hashes[i] <= hashTarget)
+      {
+        *nNonce += i + 1;
+        *phash = hashes[i];
+
+        //increment the hash counter accordingly
+        *nHashesDone += (*nNonce - orig_nNonce);
+        return *nNonce;
+      }
     }
+
+    *nNonce += nBatch;
+    *phash = hashes[nBatch - 1];
+
+    // If nothing found after trying for a while, return -1
+    if(!(*nNonce & 0xffff))
+      break;
   }
 
+  *nHashesDone += (*nNonce - orig_nNonce);
   return (u32int) -1;
 }
 
+//follows pindexBest, only the blocks that left or joined the best chain are written
+void SetBestChainByHeight(CBlockIndex *pindexNew)
+{
+  LOCK(cs_vBestChainByHeight);
+
+  vBestChainByHeight.resize(pindexNew->nHeight + 1, NULL);
+  for(CBlockIndex *pindex = pindexNew; pindex && vBestChainByHeight[pindex->nHeight] != pindex; pindex = pindex->pprev)
+    vBestChainByHeight[pindex->nHeight] = pindex;
+}
+
 CBlockIndex *pindexByHeight(s32int nHeight)
 {
   if(nHeight < 0)
     return NULL;
 
-  //Get the block index by burnBlkHeight
+  //filled in by LoadBlockIndex() and SetBestChain() before pindexBest is set, so there is
+  // nothing to find before that. The genesis block is left out, as it was by the pprev
+  // walk from pindexBest this replaced
   CBlockIndex *pindex = NULL;
-  const CBlockIndex *pTestBlkIndex;
-
-  //if pindexBest is not set yet, scan through the entire map
-  if(!pindexBest)
-  {
-    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
-    {
-      pTestBlkIndex = item.second;
-      if(pTestBlkIndex->nHeight == nHeight)
-      {
-        pindex = (CBlockIndex*)pTestBlkIndex;
-        break;
-      }
-    }
-  }else{
-    for(pTestBlkIndex = pindexBest; pTestBlkIndex && pTestBlkIndex->pprev; pTestBlkIndex = pTestBlkIndex->pprev)
-      if(pTestBlkIndex->nHeight == nHeight)
-      {
-        pindex = (CBlockIndex*)pTestBlkIndex;
-        break;
-      }
-  }
+  LOCK(cs_vBestChainByHeight);
+  if(nHeight > 0 && nHeight < (s32int)vBestChainByHeight.size())
+    pindex = vBestChainByHeight[nHeight];
 
   return pindex;
 }
 
 //given a valid block height, transaction depth, out transaction dept, this will set values for those
 bool GetAllTxClassesByIndex(s32int blkHeight, s32int txDepth, s32int txOutDepth, 
-                            CBlock &blockRet, CTransaction &txRet, CTxOut &txOutRet)
+                            uint256 &hashBlockRet, CTransaction &txRet, CTxOut &txOutRet)
 {
   if(blkHeight < 0 || txDepth < 0 || txOutDepth < 0)
     return false;
@@ -4365,23 +4765,37 @@ bool GetAllTxClassesByIndex(s32int blkHeight, s32int txDepth, s32int txOutDepth,
   if(!pindex || !pindex->pprev)
     return false;
 
-  CBlock block;
-  //Read the block
-  if(!block.ReadFromDisk(pindex))
-    return false;
+  CTransaction transaction;
 
-  if(txDepth >= block.vtx.size())
-    return false;
+  //with the block's transaction offsets only the one transaction is read,
+  // blocks connected before the offsets were recorded are read whole
+  vector<unsigned int> vTxPos;
+  if(CTxDB("r").ReadBlockTxPos(pindex->GetBlockHash(), vTxPos))
+  {
+    if(txDepth >= vTxPos.size())
+      return false;
+
+    if(!transaction.ReadFromDisk(CDiskTxPos(pindex->nFile, pindex->nBlockPos, vTxPos[txDepth])))
+      return false;
+  }else{
+    CBlock block;
+    //Read the block
+    if(!block.ReadFromDisk(pindex))
+      return false;
+
+    if(txDepth >= block.vtx.size())
+      return false;
 
-  CTransaction transaction = block.vtx[txDepth];
+    transaction = block.vtx[txDepth];
+  }
 
   if(txOutDepth >= transaction.vout.size())
     return false;
 
   //we may now set the return values if nothing failed
-  blockRet = block;
-  txRet = transaction;
+  hashBlockRet = pindex->GetBlockHash();
   txOutRet = transaction.vout[txOutDepth];
+  txRet = transaction;
   
   //sucess!
   return true;
@@ -4402,21 +4816,14 @@ s32int nPoWBlocksBetween(s32int startHeight, s32int endHeight)
   if(startHeight >= endHeight || startHeight < 0 || endHeight < 0)
     return 0;
 
-  s32int between = 0;
-  CBlockIndex *pindex = pindexByHeight(endHeight);
-  
-  //Go backwards and count the number of proof of work indexes
-  for(; pindex && pindex->pprev && pindex->pprev->nHeight > startHeight; pindex = pindex->pprev)
-  {
-    if(pindex->IsProofOfWork())
-      between++;
-  }
-
-  //exited the for loop early, bad thing
-  if(!pindex || !pindex->pprev)
+  //the block at startHeight + 1 is not counted either, the burn decay has always
+  // been calculated that way
+  const CBlockIndex *pindexEnd = pindexByHeight(endHeight);
+  const CBlockIndex *pindexStart = pindexByHeight(startHeight + 1);
+  if(!pindexEnd || !pindexStart)
     return 0;
 
-  return between;
+  return pindexEnd->nChainPoWBlocks - pindexStart->nChainPoWBlocks;
 }
 
 //Calculates the has with the given input data
@@ -4428,17 +4835,45 @@ s32int nPoWBlocksBetween(s32int startHeight, s32int endHeight)
 // 
 // smallestHashRet is the returned proof-of-burn hash 
 // if fRetIntermediate is true, returns the burn hash before the multiplier is applied
-bool HashBurnData(uint256 burnBlockHash, uint256 hashPrevBlock, uint256 burnTxHash,
-                  s32int burnBlkHeight, int64 burnValue, uint256 &smallestHashRet, bool fRetIntermediate)
+//applies the multiplier to an intermediate burn hash, the final burn hash is left in hashRet,
+// returns false if it is too big to fit in a uint256
+static bool MultiplyBurnHash(const uint256 &hashIntermediate, int64 burnValue, s32int between,
+                             u32int lastBlkTime, uint256 &hashRet)
 {
-  //start off the smallest hash the absolute biggest it can be
-  smallestHashRet = ~uint256(0);
+  //the largest value a uint256 can store
+  const CBigNum bnMax(~uint256(0));
 
-  //the hashBlock must appear in the mapBlockIndex
-  if(!mapBlockIndex.count(hashPrevBlock))
-    return error("HashBurnData() : Block hash %s not found in mapBlockIndex", hashPrevBlock.ToString().c_str());
+  //calculate the multiplier for the hash, the pow() represents the decay
+  // subtracts BURN_MIN_CONFIRMS since the first block the coins get active should have 100% power
+  const double multiplier = calculate_burn_multiplier(burnValue, between);
 
-  const s32int lastBlkHeight = mapBlockIndex[hashPrevBlock]->nHeight;
+  //apply the multiplier
+  CBigNum bnTest = CBigNum(hashIntermediate) * multiplier;
+
+  //if bignum test is too big to fit in a uint256, continue
+  if(bnTest > bnMax)
+    return false;
+
+  //assign the final bnTest hash to the hashRet
+  if(lastBlkTime >= BURN_ROUND_DOWN)
+    hashRet = becomeCompact(bnTest.getuint256());
+  else
+    hashRet = bnTest.getuint256();
+
+  return true;
+}
+
+bool HashBurnData(uint256 burnBlockHash, uint256 hashPrevBlock, uint256 burnTxHash,
+                  s32int burnBlkHeight, int64 burnValue, uint256 &smallestHashRet, bool fRetIntermediate)
+{
+  //start off the smallest hash the absolute biggest it can be
+  smallestHashRet = ~uint256(0);
+
+  //the hashBlock must appear in the mapBlockIndex
+  if(!mapBlockIndex.count(hashPrevBlock))
+    return error("HashBurnData() : Block hash %s not found in mapBlockIndex", hashPrevBlock.ToString().c_str());
+
+  const s32int lastBlkHeight = mapBlockIndex[hashPrevBlock]->nHeight;
   const u32int lastBlkTime = mapBlockIndex[hashPrevBlock]->nTime;
   const s32int between = nPoWBlocksBetween(burnBlkHeight, lastBlkHeight);
 
@@ -4446,42 +4881,24 @@ bool HashBurnData(uint256 burnBlockHash, uint256 hashPrevBlock, uint256 burnTxHa
     return error("HashBurnData() : Burn transaction does not meet minimum number of confirmations %d < %d", 
                  between, BURN_MIN_CONFIRMS);
 
-  //calculate the multiplier for the hash, the pow() represents the decay
-  // subtracts BURN_MIN_CONFIRMS since the first block the coins get active should have 100% power
-  const double multiplier = calculate_burn_multiplier(burnValue, between);
-  
   //Calculate the burn hash
   {
-    //the largest value a uint256 can store
-    const CBigNum bnMax(~uint256(0));
-    CBigNum bnTest;
-
     // package the data to be hashed and hash
     CDataStream ss(SER_GETHASH, 0);
     ss << burnBlockHash << burnTxHash << hashPrevBlock;
-    CBigNum bnHash(Hash(ss.begin(), ss.end()));
+    uint256 hash = Hash(ss.begin(), ss.end());
     
     //if the intermediate burn hash is wanted, return now
     if(fRetIntermediate)
     {
-      smallestHashRet = bnHash.getuint256();
+      smallestHashRet = hash;
       
       //sucess!
       return true;
     }
 
-    //apply the multiplier
-    bnTest = bnHash * multiplier;
-
-    //if bignum test is too big to fit in a uint256, continue
-    if(bnTest > bnMax)
+    if(!MultiplyBurnHash(hash, burnValue, between, lastBlkTime, smallestHashRet))
       return false;
-
-    //assign the final bnTest hash to the smallestHashRet
-    if(lastBlkTime >= BURN_ROUND_DOWN)
-      smallestHashRet = becomeCompact(bnTest.getuint256());
-    else
-      smallestHashRet = bnTest.getuint256();
   }
 
   //impossible, used as a saftey net if something went wrong
@@ -4495,6 +4912,93 @@ bool HashBurnData(uint256 burnBlockHash, uint256 hashPrevBlock, uint256 burnTxHa
   return true;
 }
 
+//
+// Burn hash cache, what GetBurnHash() worked out for a previous block and burn coordinates.
+// Everything in it only depends on the previous block's ancestors, so entries are only
+// made and used while the previous block is in the main chain, where pindexByHeight()
+// walks those ancestors
+//
+
+//remembered burn hashes, at most this many
+#define MAX_BURN_HASH_CACHE 10000
+
+struct CBurnHashKey
+{
+  uint256 hashPrevBlock;
+  s32int burnBlkHeight, burnCTx, burnCTxOut;
+
+  CBurnHashKey(uint256 hashPrevBlockIn, s32int burnBlkHeightIn, s32int burnCTxIn, s32int burnCTxOutIn)
+    : hashPrevBlock(hashPrevBlockIn), burnBlkHeight(burnBlkHeightIn), burnCTx(burnCTxIn), burnCTxOut(burnCTxOutIn) {}
+
+  friend bool operator<(const CBurnHashKey &a, const CBurnHashKey &b)
+  {
+    if(a.hashPrevBlock != b.hashPrevBlock)
+      return a.hashPrevBlock < b.hashPrevBlock;
+    if(a.burnBlkHeight != b.burnBlkHeight)
+      return a.burnBlkHeight < b.burnBlkHeight;
+    if(a.burnCTx != b.burnCTx)
+      return a.burnCTx < b.burnCTx;
+    return a.burnCTxOut < b.burnCTxOut;
+  }
+};
+
+struct CBurnHashCacheEntry
+{
+  uint256 hashBurn;
+  uint256 hashIntermediate;
+  bool fSender;          //scriptSender is filled in, see GetBurnSendersPubKey()
+  CScript scriptSender;
+};
+
+static map<CBurnHashKey, CBurnHashCacheEntry> mapBurnHashCache;
+static std::deque<CBurnHashKey> dequeBurnHashCache; //oldest first, for eviction
+static CCriticalSection cs_mapBurnHashCache;
+
+static bool BurnHashCacheable(const uint256 &hashPrevBlock)
+{
+  map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
+  return mi != mapBlockIndex.end() && mi->second->IsInMainChain();
+}
+
+static bool ReadBurnHashCache(const CBurnHashKey &key, CBurnHashCacheEntry &entryRet)
+{
+  if(!BurnHashCacheable(key.hashPrevBlock))
+    return false;
+
+  LOCK(cs_mapBurnHashCache);
+  map<CBurnHashKey, CBurnHashCacheEntry>::const_iterator mi = mapBurnHashCache.find(key);
+  if(mi == mapBurnHashCache.end())
+    return false;
+
+  entryRet = mi->second;
+  return true;
+}
+
+static void WriteBurnHashCache(const CBurnHashKey &key, const CBurnHashCacheEntry &entry)
+{
+  if(!BurnHashCacheable(key.hashPrevBlock))
+    return;
+
+  LOCK(cs_mapBurnHashCache);
+  if(!mapBurnHashCache.count(key))
+  {
+    dequeBurnHashCache.push_back(key);
+    if(dequeBurnHashCache.size() > MAX_BURN_HASH_CACHE)
+    {
+      mapBurnHashCache.erase(dequeBurnHashCache.front());
+      dequeBurnHashCache.pop_front();
+    }
+  }
+
+  mapBurnHashCache[key] = entry;
+}
+
+bool IsBurnHashCached(uint256 hashPrevBlock, s32int burnBlkHeight, s32int burnCTx, s32int burnCTxOut)
+{
+  CBurnHashCacheEntry entry;
+  return ReadBurnHashCache(CBurnHashKey(hashPrevBlock, burnBlkHeight, burnCTx, burnCTxOut), entry);
+}
+
 //Gets the hash for PoB given only the indexes and a hashPrevBlock, usually the best block's hash at the time
 // This function does the sanity checks, the HashBurnData() does the actual hashing
 bool GetBurnHash(uint256 hashPrevBlock, s32int burnBlkHeight, s32int burnCTx,
@@ -4508,15 +5012,22 @@ bool GetBurnHash(uint256 hashPrevBlock, s32int burnBlkHeight, s32int burnCTx,
     return error("GetBurnHash(): Input indexes are invalid %d:%d:%d\n", 
                  burnBlkHeight, burnCTx, burnCTxOut);
 
-  CBlock block;
+  //worked out before
+  const CBurnHashKey key(hashPrevBlock, burnBlkHeight, burnCTx, burnCTxOut);
+  CBurnHashCacheEntry entry;
+  if(ReadBurnHashCache(key, entry))
+  {
+    smallestHashRet = fRetIntermediate ? entry.hashIntermediate : entry.hashBurn;
+    return true;
+  }
+
+  uint256 txHashBlock;
   CTransaction burnTx;
   CTxOut burnTxOut;
 
-  if(!GetAllTxClassesByIndex(burnBlkHeight, burnCTx, burnCTxOut, block, burnTx, burnTxOut))
+  if(!GetAllTxClassesByIndex(burnBlkHeight, burnCTx, burnCTxOut, txHashBlock, burnTx, burnTxOut))
     return error("GetBurnHash(): Unable to read burn transaction %d:%d:%d\n", burnBlkHeight, burnCTx, burnCTxOut);
 
-  const uint256 txHashBlock = block.GetHash();
-
   //check if burnTxOut's address is a burn address
   // with a bunch of sanity checks
   CBurnAddress burnAddress;
@@ -4535,9 +5046,53 @@ bool GetBurnHash(uint256 hashPrevBlock, s32int burnBlkHeight, s32int burnCTx,
   if(!burnTxOut.nValue)
     return error("GetBurnHash(): Burn transaction's value is 0");
 
-  //passed all sanity checks, now do the actuall hashing
-  return HashBurnData(txHashBlock, hashPrevBlock, burnTx.GetHash(), 
-                      burnBlkHeight , burnTxOut.nValue, smallestHashRet, fRetIntermediate);
+  //passed all sanity checks, now do the actuall hashing, both hashes are cached together
+  // as checking a PoB block asks for both
+  const bool fBurn = HashBurnData(txHashBlock, hashPrevBlock, burnTx.GetHash(), 
+                                  burnBlkHeight , burnTxOut.nValue, entry.hashBurn, false);
+  const bool fIntermediate = HashBurnData(txHashBlock, hashPrevBlock, burnTx.GetHash(), 
+                                          burnBlkHeight , burnTxOut.nValue, entry.hashIntermediate, true);
+
+  if(fBurn && fIntermediate)
+  {
+    entry.fSender = false;
+    WriteBurnHashCache(key, entry);
+  }
+
+  smallestHashRet = fRetIntermediate ? entry.hashIntermediate : entry.hashBurn;
+  return fRetIntermediate ? fIntermediate : fBurn;
+}
+
+bool GetBurnSendersPubKey(uint256 hashPrevBlock, s32int burnBlkHeight, s32int burnCTx,
+                          s32int burnCTxOut, CScript &scriptRet)
+{
+  const CBurnHashKey key(hashPrevBlock, burnBlkHeight, burnCTx, burnCTxOut);
+  CBurnHashCacheEntry entry;
+  const bool fCached = ReadBurnHashCache(key, entry);
+  if(fCached && entry.fSender)
+  {
+    scriptRet = entry.scriptSender;
+    return true;
+  }
+
+  uint256 hashIndexBlock;
+  CTransaction indexTx;
+  CTxOut indexTxOut;
+  if(!GetAllTxClassesByIndex(burnBlkHeight, burnCTx, burnCTxOut, hashIndexBlock, indexTx, indexTxOut))
+    return false;
+
+  if(!indexTx.GetSendersPubKey(scriptRet))
+    return false;
+
+  //only added to the burn hashes already there
+  if(fCached)
+  {
+    entry.fSender = true;
+    entry.scriptSender = scriptRet;
+    WriteBurnHashCache(key, entry);
+  }
+
+  return true;
 }
 
 //Scans all of the hashes of this transaction and returns the smallest one
@@ -4599,40 +5154,285 @@ bool ScanBurnHashes(const CWalletTx &burnWTx, uint256 &smallestHashRet)
                       pindex->nHeight, burnTxOut.nValue, smallestHashRet, false);
 }
 
+//
+// Burn candidates, the wallet's burn transactions with everything their burn hash
+// needs that does not change from one best block to the next
+//
+
+//candidates are split into work items of this many once there are more of them
+#define BURN_HASH_CHUNK 256
+
+struct CBurnCandidate
+{
+  uint256 hashTx;
+  uint256 hashBlock;
+  CBlockIndex *pindex; //the block holding the burn transaction
+  int64 nValue;
+  SHA256_CTX ctxMid;   //hashBlock and hashTx already hashed in, see HashBurnData()
+};
+
+static map<uint256, CBurnCandidate> mapBurnCandidates;
+//taken after cs_main and the wallet's cs_wallet, never before them
+static CCriticalSection cs_mapBurnCandidates;
+static CWorkQueue burnHashQueue("ThreadBurnHash");
+
+//runs the burn hash threads for as long as the AfterBurner is running
+class CBurnHashThreads
+{
+public:
+  CBurnHashThreads()
+  {
+    //the AfterBurner hashes too while it waits on them
+    burnHashQueue.Start((int)boost::thread::hardware_concurrency() - 1);
+  }
+
+  ~CBurnHashThreads()
+  {
+    burnHashQueue.Stop();
+  }
+};
+
+//a mature candidate and its PoW depth for the current best block
+struct CBurnHashJob
+{
+  const CBurnCandidate *pcandidate;
+  s32int between;
+};
+
+//hashes a range of candidates against one previous block, keeping the smallest
+class CBurnHashRange : public CWorkItem
+{
+public:
+  const std::vector<CBurnHashJob> *pvJobs;
+  u32int nBegin, nEnd;
+  uint256 hashPrevBlock;
+  u32int lastBlkTime;
+
+  uint256 hashBest;
+  const CBurnCandidate *pcandidateBest;
+
+  void Run()
+  {
+    hashBest = ~uint256(0);
+    pcandidateBest = NULL;
+
+    for(u32int i = nBegin; i < nEnd; i++)
+    {
+      const CBurnHashJob &job = (*pvJobs)[i];
+
+      //the same double SHA256 HashBurnData() does, starting from the midstate
+      SHA256_CTX ctx = job.pcandidate->ctxMid;
+      uint256 hash1, hash;
+      SHA256_Update(&ctx, (unsigned char*)&hashPrevBlock, sizeof(hashPrevBlock));
+      SHA256_Final((unsigned char*)&hash1, &ctx);
+      SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash);
+
+      uint256 hashBurn;
+      if(!MultiplyBurnHash(hash, job.pcandidate->nValue, job.between, lastBlkTime, hashBurn) || !hashBurn)
+        continue;
+
+      if(hashBurn < hashBest)
+      {
+        hashBest = hashBurn;
+        pcandidateBest = job.pcandidate;
+      }
+    }
+  }
+};
+
+//brings mapBurnCandidates in line with the wallet, only new or moved burn
+// transactions are read from it, cs_main, pwallet->cs_wallet and cs_mapBurnCandidates
+// must be held
+static void UpdateBurnCandidates(CWallet *pwallet)
+{
+  map<uint256, CBurnCandidate> mapNew;
+  BOOST_FOREACH(const uint256 &hashTx, pwallet->setBurnHashes)
+  {
+    map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(hashTx);
+    if(mi == pwallet->mapWallet.end())
+      continue;
+    const CWalletTx &wtx = mi->second;
+
+    //still in the same block, nothing to update
+    map<uint256, CBurnCandidate>::iterator it = mapBurnCandidates.find(hashTx);
+    if(it != mapBurnCandidates.end() && it->second.hashBlock == wtx.hashBlock)
+    {
+      mapNew[hashTx] = it->second;
+      continue;
+    }
+
+    //not in a block yet, or in one off the main chain, this also verifies the merkle branch
+    if(!wtx.hashBlock || wtx.GetDepthInMainChain() <= 0)
+      continue;
+
+    map<uint256, CBlockIndex*>::iterator miIndex = mapBlockIndex.find(wtx.hashBlock);
+    if(miIndex == mapBlockIndex.end())
+      continue;
+
+    const CTxOut burnTxOut = wtx.GetBurnOutTx();
+    if(burnTxOut.IsNull() || !burnTxOut.nValue)
+      continue;
+
+    CBurnCandidate &candidate = mapNew[hashTx];
+    candidate.hashTx = hashTx;
+    candidate.hashBlock = wtx.hashBlock;
+    candidate.pindex = miIndex->second;
+    candidate.nValue = burnTxOut.nValue;
+
+    SHA256_Init(&candidate.ctxMid);
+    SHA256_Update(&candidate.ctxMid, (unsigned char*)&candidate.hashBlock, sizeof(candidate.hashBlock));
+    SHA256_Update(&candidate.ctxMid, (unsigned char*)&candidate.hashTx, sizeof(candidate.hashTx));
+  }
+
+  mapBurnCandidates.swap(mapNew);
+}
+
 //returns the (if found) the best hash with the transaction that produced it
 void HashAllBurntTx(uint256 &smallestHashRet, CWalletTx &smallestWTxRet)
 {
   //give the smallest hash the absolute largest value it can hold
   smallestHashRet = ~uint256(0);
 
+  //the same order calcburnhash holds them in under CRPCTable::execute()
+  LOCK2(cs_main, pwalletMain->cs_wallet);
+
   //if the best index is not a proof-of-work index, do not bother hashing as it will throw errors
-  if(!pindexBest->IsProofOfWork())
+  CBlockIndex *pindexPrev = pindexBest;
+  if(!pindexPrev->IsProofOfWork())
     return;
 
-  //go through all of the burnt hashes in the setBurnHashes
-  for(set<uint256>::iterator it = pwalletMain->setBurnHashes.begin(); 
-      it != pwalletMain->setBurnHashes.end(); ++it)
+  LOCK(cs_mapBurnCandidates);
+  UpdateBurnCandidates(pwalletMain);
+
+  //only the decay depends on the best block besides the hash itself
+  std::vector<CBurnHashJob> vJobs;
+  vJobs.reserve(mapBurnCandidates.size());
+  for(map<uint256, CBurnCandidate>::const_iterator it = mapBurnCandidates.begin(); it != mapBurnCandidates.end(); ++it)
   {
-    if(!pwalletMain->mapWallet.count(*it))
+    const CBurnCandidate &candidate = it->second;
+    if(!candidate.pindex->IsInMainChain())
       continue;
 
-    CWalletTx tmpWTx = pwalletMain->mapWallet[*it];
-    if(!tmpWTx.IsBurnTxMature()) //transaction has to have at least some confirmations
+    CBurnHashJob job;
+    job.pcandidate = &candidate;
+    job.between = nPoWBlocksBetween(candidate.pindex->nHeight, pindexPrev->nHeight);
+    if(job.between < BURN_MIN_CONFIRMS) //transaction has to have at least some confirmations
       continue;
 
-    uint256 tmpHash;
-    if(!ScanBurnHashes(tmpWTx, tmpHash))
-      continue;
+    vJobs.push_back(job);
+  }
+
+  //split across the burn hash threads, the calling thread runs whatever is left in Wait()
+  const u32int nChunks = (vJobs.size() + BURN_HASH_CHUNK - 1) / BURN_HASH_CHUNK;
+  std::vector<CBurnHashRange> vRanges(nChunks);
+  for(u32int i = 0; i < nChunks; i++)
+  {
+    vRanges[i].pvJobs = &vJobs;
+    vRanges[i].nBegin = i * BURN_HASH_CHUNK;
+    vRanges[i].nEnd = std::min((u32int)vJobs.size(), (i + 1) * BURN_HASH_CHUNK);
+    vRanges[i].hashPrevBlock = pindexPrev->GetBlockHash();
+    vRanges[i].lastBlkTime = pindexPrev->nTime;
+    burnHashQueue.Push(&vRanges[i]);
+  }
 
-    if(tmpHash < smallestHashRet)
+  const CBurnCandidate *pcandidateBest = NULL;
+  for(u32int i = 0; i < nChunks; i++)
+  {
+    burnHashQueue.Wait(&vRanges[i]);
+    if(vRanges[i].pcandidateBest && vRanges[i].hashBest < smallestHashRet)
     {
-      smallestHashRet = tmpHash;
-      smallestWTxRet = const_cast<const CWalletTx&>(tmpWTx);
+      smallestHashRet = vRanges[i].hashBest;
+      pcandidateBest = vRanges[i].pcandidateBest;
     }
+  }
 
+  //the one wallet transaction copied
+  if(pcandidateBest)
+  {
+    map<uint256, CWalletTx>::const_iterator mi = pwalletMain->mapWallet.find(pcandidateBest->hashTx);
+    if(mi != pwalletMain->mapWallet.end())
+      smallestWTxRet = mi->second;
+    else
+      smallestHashRet = ~uint256(0);
   }
-  
-  return;
+}
+
+u32int GetProjectedBurnTarget(const CBlockIndex *pindexLast, u32int nPoWAhead)
+{
+  if(!nPoWAhead)
+    return GetNextBurnTargetRequired(pindexLast);
+
+  //blocks still to come are well past the switch time, so only the new protocol applies
+  return GetBurnTargetAfterPoW(pindexLast->pindexLastPoB, pindexLast->nPoWSinceLastPoB + nPoWAhead);
+}
+
+//projects a range of burn transactions over every step
+class CBurnSimRange : public CWorkItem
+{
+public:
+  std::vector<CBurnSimulation> *pvSims;
+  u32int nBegin, nEnd;
+  u32int nHorizon;
+  uint256 hashPrevBlock;
+  u32int lastBlkTime;     //of step 0
+  u32int projectedTime;   //of the steps after it
+
+  void Run()
+  {
+    for(u32int i = nBegin; i < nEnd; i++)
+    {
+      CBurnSimulation &sim = (*pvSims)[i];
+
+      //one intermediate hash for every step, the same one HashBurnData() would make
+      CDataStream ss(SER_GETHASH, 0);
+      ss << sim.hashBlock << sim.hashTx << hashPrevBlock;
+      sim.hashIntermediate = Hash(ss.begin(), ss.end());
+
+      sim.vHashes.assign(nHorizon + 1, ~uint256(0));
+      for(u32int nStep = 0; nStep <= nHorizon; nStep++)
+      {
+        const s32int between = sim.GetBetween(nStep);
+        if(between < BURN_MIN_CONFIRMS)
+          continue;
+
+        uint256 hashBurn;
+        if(MultiplyBurnHash(sim.hashIntermediate, sim.nValue, between,
+                            nStep ? projectedTime : lastBlkTime, hashBurn) && hashBurn != 0)
+          sim.vHashes[nStep] = hashBurn;
+      }
+    }
+  }
+};
+
+void SimulateBurnHashes(std::vector<CBurnSimulation> &vSims, u32int nHorizon)
+{
+  const CBlockIndex *pindexPrev = pindexBest;
+
+  for(u32int i = 0; i < vSims.size(); i++)
+  {
+    CBurnSimulation &sim = vSims[i];
+    sim.nBetween = sim.nHeight < pindexPrev->nHeight ?
+      nPoWBlocksBetween(sim.nHeight, pindexPrev->nHeight) : -1;
+  }
+
+  //every step is a bignum multiply, so the longer the horizon the fewer transactions to a chunk
+  const u32int nPerChunk = std::max((u32int)1, BURN_HASH_CHUNK / (nHorizon + 1));
+  const u32int nChunks = (vSims.size() + nPerChunk - 1) / nPerChunk;
+  std::vector<CBurnSimRange> vRanges(nChunks);
+  for(u32int i = 0; i < nChunks; i++)
+  {
+    vRanges[i].pvSims = &vSims;
+    vRanges[i].nBegin = i * nPerChunk;
+    vRanges[i].nEnd = std::min((u32int)vSims.size(), (i + 1) * nPerChunk);
+    vRanges[i].nHorizon = nHorizon;
+    vRanges[i].hashPrevBlock = pindexPrev->GetBlockHash();
+    vRanges[i].lastBlkTime = pindexPrev->nTime;
+    vRanges[i].projectedTime = std::max((int64)pindexPrev->nTime, GetAdjustedTime());
+    burnHashQueue.Push(&vRanges[i]);
+  }
+
+  for(u32int i = 0; i < nChunks; i++)
+    burnHashQueue.Wait(&vRanges[i]);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -4672,103 +5472,10 @@ uint64 nLastBlockTx = 0;
 uint64 nLastBlockSize = 0;
 int64 nLastCoinStakeSearchInterval = 0;
 
-// CreateNewBlock:
-//   fProofOfStake: try (best effort) to make a proof-of-stake block
-//   burnWalletTx is the walletTx for a burn transaction that when hashed, produces a valid hash <= burn target
-CBlock *CreateNewBlock(CWallet* pwallet, bool fProofOfStake, const CWalletTx *burnWalletTx, CReserveKey *resKey)
+//collects the memory pool transactions that aren't in pblock yet into it, highest
+// priority first, state carries the totals of the transactions already collected
+static void AddMempoolTransactions(CBlock *pblock, CBlockIndex *pindexPrev, CNewBlockState &state)
 {
-  //if resKey exists, use it, else make a temporary reservekey
-  CReserveKey tmpResKey(pwallet);
-  CReserveKey *reservekey = resKey ? resKey : &tmpResKey;
-
-  // Create new block
-  auto_ptr<CBlock> pblock(new CBlock());
-  if(!pblock.get())
-    return NULL;
-
-  //if the burnWalletTx is a non-NULL pointer, set the burn coords
-  if(burnWalletTx)
-  {
-    if(!mapBlockIndex.count(burnWalletTx->hashBlock))
-      return NULL;
-
-    pblock->fProofOfBurn = true;
-    pblock->hashBurnBlock = burnWalletTx->hashBlock;
-    pblock->burnBlkHeight = mapBlockIndex[burnWalletTx->hashBlock]->nHeight;
-    pblock->burnCTx = burnWalletTx->nIndex;
-    pblock->burnCTxOut = burnWalletTx->GetBurnOutTxIndex();
-  }
-
-  // Create coinbase tx
-  CTransaction txNew;
-  txNew.vin.resize(1);
-  txNew.vin[0].prevout.SetNull();
-  txNew.vout.resize(1);
-
-  //handle the public key of burn block differently
-  if(pblock->IsProofOfBurn())
-  {
-    CBlock burnBlock;
-    CTransaction burnTx;
-    CTxOut burnTxOut;
-
-    //given the burn coords in pblock, set the class objects burnBlock, burnTx, burnTxOut
-    if(!GetAllTxClassesByIndex(pblock->burnBlkHeight, pblock->burnCTx, pblock->burnCTxOut, 
-                               burnBlock, burnTx, burnTxOut))
-      return NULL;
-
-    CScript sendersPubKey;
-    if(!burnTx.GetSendersPubKey(sendersPubKey, true))
-      return NULL;
-
-    vector<valtype> vSolutions;
-    txnouttype whichType;
-    if(!Solver(sendersPubKey, whichType, vSolutions))
-      return NULL;
-
-    if(whichType != TX_PUBKEY)
-      return NULL;
-
-    txNew.vout[0].scriptPubKey << vSolutions[0];
-  }else
-    txNew.vout[0].scriptPubKey << reservekey->GetReservedKey();
-
-  txNew.vout[0].scriptPubKey << OP_CHECKSIG;
-
-  // Add our coinbase tx as first transaction
-  pblock->vtx.push_back(txNew);
-
-  // heat: if coinstake available add coinstake tx
-  static int64 nLastCoinStakeSearchTime = GetAdjustedTime();  // only initialized at startup
-  CBlockIndex *pindexPrev = pindexBest;
-
-  if(fProofOfStake)  // attemp to find a coinstake
-  {
-    pblock->nBits = GetNextTargetRequired(pindexPrev, true);
-    CTransaction txCoinStake;
-    int64 nSearchTime = txCoinStake.nTime; // search to current time
-    if(nSearchTime > nLastCoinStakeSearchTime)
-    {
-      if(pwallet->CreateCoinStake(*pwallet, pblock->nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake))
-      {
-        if(txCoinStake.nTime >= max(pindexPrev->GetMedianTimePast()+1, pindexPrev->GetBlockTime() - nMaxClockDrift))
-        {   
-          // make sure coinstake would meet timestamp protocol
-          // as it would be the same as the block timestamp
-          pblock->vtx[0].vout[0].SetEmpty();
-          pblock->vtx[0].nTime = txCoinStake.nTime;
-
-          pblock->vtx.push_back(txCoinStake);
-        }
-      }
-      nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
-      nLastCoinStakeSearchTime = nSearchTime;
-    }
-  }
-
-  pblock->nBits = GetNextTargetRequired(pindexPrev, pblock->IsProofOfStake());
-
-  // Collect memory pool transactions into the block
   int64 nFees = 0;
   {
     LOCK2(cs_main, mempool.cs);
@@ -4784,6 +5491,10 @@ CBlock *CreateNewBlock(CWallet* pwallet, bool fProofOfStake, const CWalletTx *bu
       if(tx.IsCoinBase() || tx.IsCoinStake() || !tx.IsFinal())
         continue;
 
+      //collected into the block already
+      if(state.mapTestPool.count((*mi).first))
+        continue;
+
       COrphan* porphan = NULL;
       double dPriority = 0;
       BOOST_FOREACH(const CTxIn& txin, tx.vin)
@@ -4793,6 +5504,10 @@ CBlock *CreateNewBlock(CWallet* pwallet, bool fProofOfStake, const CWalletTx *bu
         CTxIndex txindex;
         if(!txPrev.ReadFromDisk(txdb, txin.prevout, txindex))
         {
+          //a parent collected into the block already adds no priority
+          if(state.mapTestPool.count(txin.prevout.hash))
+            continue;
+
           // Has to wait for dependencies
           if(!porphan)
           {
@@ -4834,10 +5549,7 @@ CBlock *CreateNewBlock(CWallet* pwallet, bool fProofOfStake, const CWalletTx *bu
     }
 
     // Collect transactions into block
-    map<uint256, CTxIndex> mapTestPool;
-    uint64 nBlockSize = 1000;
-    uint64 nBlockTx = 0;
-    int nBlockSigOps = 100;
+    map<uint256, CTxIndex> &mapTestPool = state.mapTestPool;
     while(!mapPriority.empty())
     {
       // Take highest priority transaction off priority queue
@@ -4846,74 +5558,198 @@ CBlock *CreateNewBlock(CWallet* pwallet, bool fProofOfStake, const CWalletTx *bu
 
       // Size limits
       unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-      if(nBlockSize + nTxSize >= MAX_BLOCK_SIZE_GEN)
+      if(state.nBlockSize + nTxSize >= MAX_BLOCK_SIZE_GEN)
+        continue;
+
+      // Legacy limits on sigOps:
+      unsigned int nTxSigOps = tx.GetLegacySigOpCount();
+      if(state.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+        continue;
+
+      // Timestamp limit
+      if(tx.nTime > GetAdjustedTime() || (pblock->IsProofOfStake() && tx.nTime > pblock->vtx[1].nTime))
         continue;
 
-      // Legacy limits on sigOps:
-      unsigned int nTxSigOps = tx.GetLegacySigOpCount();
-      if(nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-        continue;
+      // heat: simplify transaction fee - allow free = false
+      int64 nMinFee = tx.GetMinFee(state.nBlockSize, false, GMF_BLOCK);
+
+      // Connecting shouldn't fail due to dependency on other memory pool transactions
+      // because we're already processing them in order of dependency
+      map<uint256, CTxIndex> mapTestPoolTmp(mapTestPool);
+      MapPrevTx mapInputs;
+      bool fInvalid;
+      if(!tx.FetchInputs(txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid))
+        continue;
+
+      int64 nTxFees = tx.GetValueIn(mapInputs) - tx.GetValueOut();
+
+      if(nTxFees < nMinFee)
+        continue;
+
+      nTxSigOps += tx.GetP2SHSigOpCount(mapInputs);
+
+      if(state.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+        continue;
+
+      if(!tx.ConnectInputs(txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1,1,1), pindexPrev, false, true))
+        continue;
+
+      mapTestPoolTmp[tx.GetHash()] = CTxIndex(CDiskTxPos(1,1,1), tx.vout.size());
+      swap(mapTestPool, mapTestPoolTmp);
+
+      // Added
+      pblock->vtx.push_back(tx);
+      state.nBlockSize += nTxSize;
+      ++state.nBlockTx;
+      state.nBlockSigOps += nTxSigOps;
+      nFees += nTxFees;
+
+      // Add transactions that depend on this one to the priority queue
+      uint256 hash = tx.GetHash();
+      if(mapDependers.count(hash))
+      {
+        BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
+        {
+          if(!porphan->setDependsOn.empty())
+          {
+            porphan->setDependsOn.erase(hash);
+            if(porphan->setDependsOn.empty())
+              mapPriority.insert(make_pair(-porphan->dPriority, porphan->ptx));
+          }
+        }
+      }
+    }
+
+    nLastBlockTx = state.nBlockTx;
+    nLastBlockSize = state.nBlockSize;
+    if(fDebug && GetBoolArg("-printpriority"))
+      printf("CreateNewBlock(): total size %lu\n", state.nBlockSize);
+
+  }
+}
+
+//set the pblock's effective burn content
+static void SetNewBlockBurnCoins(CBlock *pblock, CBlockIndex *pindexPrev)
+{
+  int64 nBurnedCoins = 0;
+  BOOST_FOREACH(const CTransaction &tx, pblock->vtx)
+  {
+    s32int burnOutTxIndex = tx.GetBurnOutTxIndex();
+    if(burnOutTxIndex != -1) //this is a burn transaction
+      nBurnedCoins += tx.vout[burnOutTxIndex].nValue;
+  }
+
+  //apply the decay only when this block is a proof of work block
+  if(pblock->IsProofOfWork())
+    //The new blocks nEffectiveBurnCoins is (the last blocks effective burn coins / BURN_DECAY_RATE) + nBurnCoins
+    pblock->nEffectiveBurnCoins = (int64)((pindexPrev->nEffectiveBurnCoins / BURN_DECAY_RATE) + nBurnedCoins);
+  else
+    pblock->nEffectiveBurnCoins = pindexPrev->nEffectiveBurnCoins + nBurnedCoins;
+}
+
+// CreateNewBlock:
+//   fProofOfStake: try (best effort) to make a proof-of-stake block
+//   burnWalletTx is the walletTx for a burn transaction that when hashed, produces a valid hash <= burn target
+//   pstate, if given, receives the totals AddToNewBlock needs to add to the block later
+CBlock *CreateNewBlock(CWallet* pwallet, bool fProofOfStake, const CWalletTx *burnWalletTx, CReserveKey *resKey,
+                       CNewBlockState *pstate)
+{
+  //if resKey exists, use it, else make a temporary reservekey
+  CReserveKey tmpResKey(pwallet);
+  CReserveKey *reservekey = resKey ? resKey : &tmpResKey;
+
+  // Create new block
+  auto_ptr<CBlock> pblock(new CBlock());
+  if(!pblock.get())
+    return NULL;
+
+  //if the burnWalletTx is a non-NULL pointer, set the burn coords
+  if(burnWalletTx)
+  {
+    if(!mapBlockIndex.count(burnWalletTx->hashBlock))
+      return NULL;
 
-      // Timestamp limit
-      if(tx.nTime > GetAdjustedTime() || (pblock->IsProofOfStake() && tx.nTime > pblock->vtx[1].nTime))
-        continue;
+    pblock->fProofOfBurn = true;
+    pblock->hashBurnBlock = burnWalletTx->hashBlock;
+    pblock->burnBlkHeight = mapBlockIndex[burnWalletTx->hashBlock]->nHeight;
+    pblock->burnCTx = burnWalletTx->nIndex;
+    pblock->burnCTxOut = burnWalletTx->GetBurnOutTxIndex();
+  }
 
-      // heat: simplify transaction fee - allow free = false
-      int64 nMinFee = tx.GetMinFee(nBlockSize, false, GMF_BLOCK);
+  // Create coinbase tx
+  CTransaction txNew;
+  txNew.vin.resize(1);
+  txNew.vin[0].prevout.SetNull();
+  txNew.vout.resize(1);
 
-      // Connecting shouldn't fail due to dependency on other memory pool transactions
-      // because we're already processing them in order of dependency
-      map<uint256, CTxIndex> mapTestPoolTmp(mapTestPool);
-      MapPrevTx mapInputs;
-      bool fInvalid;
-      if(!tx.FetchInputs(txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid))
-        continue;
+  //handle the public key of burn block differently
+  if(pblock->IsProofOfBurn())
+  {
+    uint256 hashBurnBlock;
+    CTransaction burnTx;
+    CTxOut burnTxOut;
 
-      int64 nTxFees = tx.GetValueIn(mapInputs) - tx.GetValueOut();
+    //given the burn coords in pblock, set the class objects hashBurnBlock, burnTx, burnTxOut
+    if(!GetAllTxClassesByIndex(pblock->burnBlkHeight, pblock->burnCTx, pblock->burnCTxOut, 
+                               hashBurnBlock, burnTx, burnTxOut))
+      return NULL;
 
-      if(nTxFees < nMinFee)
-        continue;
+    CScript sendersPubKey;
+    if(!burnTx.GetSendersPubKey(sendersPubKey, true))
+      return NULL;
 
-      nTxSigOps += tx.GetP2SHSigOpCount(mapInputs);
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    if(!Solver(sendersPubKey, whichType, vSolutions))
+      return NULL;
 
-      if(nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-        continue;
+    if(whichType != TX_PUBKEY)
+      return NULL;
 
-      if(!tx.ConnectInputs(txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1,1,1), pindexPrev, false, true))
-        continue;
+    txNew.vout[0].scriptPubKey << vSolutions[0];
+  }else
+    txNew.vout[0].scriptPubKey << reservekey->GetReservedKey();
 
-      mapTestPoolTmp[tx.GetHash()] = CTxIndex(CDiskTxPos(1,1,1), tx.vout.size());
-      swap(mapTestPool, mapTestPoolTmp);
+  txNew.vout[0].scriptPubKey << OP_CHECKSIG;
 
-      // Added
-      pblock->vtx.push_back(tx);
-      nBlockSize += nTxSize;
-      ++nBlockTx;
-      nBlockSigOps += nTxSigOps;
-      nFees += nTxFees;
+  // Add our coinbase tx as first transaction
+  pblock->vtx.push_back(txNew);
 
-      // Add transactions that depend on this one to the priority queue
-      uint256 hash = tx.GetHash();
-      if(mapDependers.count(hash))
+  // heat: if coinstake available add coinstake tx
+  static int64 nLastCoinStakeSearchTime = GetAdjustedTime();  // only initialized at startup
+  CBlockIndex *pindexPrev = pindexBest;
+
+  if(fProofOfStake)  // attemp to find a coinstake
+  {
+    pblock->nBits = GetNextTargetRequired(pindexPrev, true);
+    CTransaction txCoinStake;
+    int64 nSearchTime = txCoinStake.nTime; // search to current time
+    if(nSearchTime > nLastCoinStakeSearchTime)
+    {
+      if(pwallet->CreateCoinStake(*pwallet, pblock->nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake))
       {
-        BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
-        {
-          if(!porphan->setDependsOn.empty())
-          {
-            porphan->setDependsOn.erase(hash);
-            if(porphan->setDependsOn.empty())
-              mapPriority.insert(make_pair(-porphan->dPriority, porphan->ptx));
-          }
+        if(txCoinStake.nTime >= max(pindexPrev->GetMedianTimePast()+1, pindexPrev->GetBlockTime() - nMaxClockDrift))
+        {   
+          // make sure coinstake would meet timestamp protocol
+          // as it would be the same as the block timestamp
+          pblock->vtx[0].vout[0].SetEmpty();
+          pblock->vtx[0].nTime = txCoinStake.nTime;
+
+          pblock->vtx.push_back(txCoinStake);
         }
       }
+      nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
+      nLastCoinStakeSearchTime = nSearchTime;
     }
+  }
 
-    nLastBlockTx = nBlockTx;
-    nLastBlockSize = nBlockSize;
-    if(fDebug && GetBoolArg("-printpriority"))
-      printf("CreateNewBlock(): total size %lu\n", nBlockSize);
+  pblock->nBits = GetNextTargetRequired(pindexPrev, pblock->IsProofOfStake());
 
-  }
+  // Collect memory pool transactions into the block
+  CNewBlockState stateTmp;
+  CNewBlockState &state = pstate ? *pstate : stateTmp;
+  state = CNewBlockState();
+  AddMempoolTransactions(pblock.get(), pindexPrev, state);
 
   // Fill in header
   pblock->hashPrevBlock = pindexPrev->GetBlockHash();
@@ -4930,21 +5766,7 @@ CBlock *CreateNewBlock(CWallet* pwallet, bool fProofOfStake, const CWalletTx *bu
 
   pblock->nNonce = 0;
 
-  //set the pblock's effective burn content
-  int64 nBurnedCoins = 0;
-  BOOST_FOREACH(const CTransaction &tx, pblock->vtx)
-  {
-    s32int burnOutTxIndex = tx.GetBurnOutTxIndex();
-    if(burnOutTxIndex != -1) //this is a burn transaction
-      nBurnedCoins += tx.vout[burnOutTxIndex].nValue;
-  }
-
-  //apply the decay only when this block is a proof of work block
-  if(pblock->IsProofOfWork())
-    //The new blocks nEffectiveBurnCoins is (the last blocks effective burn coins / BURN_DECAY_RATE) + nBurnCoins
-    pblock->nEffectiveBurnCoins = (int64)((pindexPrev->nEffectiveBurnCoins / BURN_DECAY_RATE) + nBurnedCoins);
-  else
-    pblock->nEffectiveBurnCoins = pindexPrev->nEffectiveBurnCoins + nBurnedCoins;
+  SetNewBlockBurnCoins(pblock.get(), pindexPrev);
 
   pblock->nBurnBits = GetNextBurnTargetRequired(pindexPrev);
 
@@ -4957,6 +5779,33 @@ CBlock *CreateNewBlock(CWallet* pwallet, bool fProofOfStake, const CWalletTx *bu
   return pblock.release();
 }
 
+unsigned int AddToNewBlock(CBlock *pblock, CNewBlockState &state)
+{
+  CBlockIndex *pindexPrev = pindexBest;
+  if(pblock->hashPrevBlock != pindexPrev->GetBlockHash())
+    return 0;
+
+  unsigned int nTxBefore = pblock->vtx.size();
+  AddMempoolTransactions(pblock, pindexPrev, state);
+  if(pblock->vtx.size() == nTxBefore)
+    return 0;
+
+  //the fields CreateNewBlock worked out from the transactions
+  pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+  pblock->nTime = max(pblock->GetBlockTime(), pblock->GetMaxTransactionTime());
+  SetNewBlockBurnCoins(pblock, pindexPrev);
+
+  return pblock->vtx.size() - nTxBefore;
+}
+
+
+static void SetExtraNonce(CBlock *pblock, unsigned int nExtraNonce)
+{
+  pblock->vtx[0].vin[0].scriptSig = (CScript() << pblock->nTime << CBigNum(nExtraNonce)) + COINBASE_FLAGS;
+  assert(pblock->vtx[0].vin[0].scriptSig.size() <= 100);
+
+  pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+}
 
 void IncrementExtraNonce(CBlock *pblock, CBlockIndex *pindexPrev, unsigned int &nExtraNonce)
 {
@@ -4968,10 +5817,7 @@ void IncrementExtraNonce(CBlock *pblock, CBlockIndex *pindexPrev, unsigned int &
     hashPrevBlock = pblock->hashPrevBlock;
   }
   ++nExtraNonce;
-  pblock->vtx[0].vin[0].scriptSig = (CScript() << pblock->nTime << CBigNum(nExtraNonce)) + COINBASE_FLAGS;
-  assert(pblock->vtx[0].vin[0].scriptSig.size() <= 100);
-
-  pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+  SetExtraNonce(pblock, nExtraNonce);
 
   return;
 }
@@ -5097,6 +5943,157 @@ static bool fGenerateheats = false;
 static bool fLimitProcessors = false;
 static int nLimitProcessors = -1;
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// Shared proof-of-work template
+//
+
+//All heatMiner threads hash one template per tip instead of each building its
+// own. The work is cut into units of one extra nonce and one 0x10000 nonce
+// chunk, numbered off an atomic counter, so threads never hash the same header
+// and never wait on each other for more work.
+
+#define MINER_NONCE_CHUNKS 0xffff //chunks per extra nonce, keeps nNonce under 0xffff0000
+
+class CMinerTemplate
+{
+public:
+  CBlock block;
+  CBlockIndex *pindexPrev;
+  unsigned int nTransactionsUpdatedLast;
+  int64 nStart;
+  CReserveKey reservekey;
+
+  //set when the template is replaced, the threads drop it at their next batch
+  volatile bool fStale;
+  //the next work unit to hand out
+  volatile u32int nNextUnit;
+
+  CMinerTemplate(CWallet *pwallet) : reservekey(pwallet)
+  {
+    pindexPrev = NULL;
+    nTransactionsUpdatedLast = 0;
+    nStart = GetTime();
+    fStale = false;
+    nNextUnit = 0;
+  }
+};
+
+static CCriticalSection cs_minerTemplate;
+static boost::shared_ptr<CMinerTemplate> pminerTemplate;
+
+//lock order is cs_main then cs_minerTemplate, SetBestChain calls in holding cs_main
+static void MinerTipChanged()
+{
+  LOCK(cs_minerTemplate);
+  if(pminerTemplate)
+    pminerTemplate->fStale = true;
+}
+
+static boost::shared_ptr<CMinerTemplate> GetMinerTemplate(CWallet *pwallet)
+{
+  {
+    LOCK(cs_minerTemplate);
+    if(pminerTemplate && !pminerTemplate->fStale)
+      return pminerTemplate;
+  }
+
+  //one thread builds the new template, the rest pick it up once they get the lock
+  LOCK2(cs_main, cs_minerTemplate);
+  if(pminerTemplate && !pminerTemplate->fStale)
+    return pminerTemplate;
+
+  boost::shared_ptr<CMinerTemplate> ptemplate(new CMinerTemplate(pwallet));
+  ptemplate->pindexPrev = pindexBest;
+  ptemplate->nTransactionsUpdatedLast = nTransactionsUpdated;
+
+  //the coinbase pays to the template's key, CheckWork keeps it for whichever thread finds the block
+  auto_ptr<CBlock> pblock(CreateNewBlock(pwallet, false, NULL, &ptemplate->reservekey));
+  if(!pblock.get())
+    return boost::shared_ptr<CMinerTemplate>();
+  ptemplate->block = *pblock;
+
+  printf("Running heatMiner with %d %s in block\n", 
+         pblock->vtx.size(), pblock->vtx.size() != 1 ? "transactions" : "transaction");
+
+  pminerTemplate = ptemplate;
+  nMinerTemplatesBuilt++;
+  nMinerTemplateTime = GetTime();
+  return ptemplate;
+}
+
+//claims a vMinerThreadStats slot for the life of a proof-of-work miner thread
+class CMinerStatsSlot
+{
+public:
+  CMinerThreadStats *pstats;
+
+  CMinerStatsSlot(bool fClaim) : pstats(NULL)
+  {
+    for(int i = 0; fClaim && i < MAX_MINER_STATS_THREADS && !pstats; i++)
+    {
+      if(__sync_bool_compare_and_swap(&vMinerThreadStats[i].fInUse, 0, 1))
+      {
+        pstats = &vMinerThreadStats[i];
+        pstats->nStartTime = pstats->nRateStart = GetTimeMillis();
+        pstats->nHashes = pstats->nMixRounds = pstats->nStaleWork = pstats->nRateHashes = 0;
+        pstats->dHashesPerSec = 0;
+      }
+    }
+  }
+
+  ~CMinerStatsSlot()
+  {
+    if(pstats)
+    {
+      pstats->dHashesPerSec = 0;
+      __sync_lock_release(&pstats->fInUse);
+    }
+  }
+};
+
+static double GetMinerHashesPerSec()
+{
+  double dTotal = 0;
+  for(int i = 0; i < MAX_MINER_STATS_THREADS; i++)
+    if(vMinerThreadStats[i].fInUse)
+      dTotal += vMinerThreadStats[i].dHashesPerSec;
+  return dTotal;
+}
+
+static void MeterHashes(CMinerThreadStats *pstats, unsigned int nHashesDone, uint64 nMixRounds,
+                        const uint256 &hashTarget)
+{
+  if(!pstats)
+    return;
+
+  __sync_fetch_and_add(&pstats->nHashes, (uint64)nHashesDone);
+  __sync_fetch_and_add(&pstats->nMixRounds, nMixRounds);
+
+  // Meter hashes/sec, each thread over its own window
+  int64 nNow = GetTimeMillis();
+  if(nNow - pstats->nRateStart > 4000)
+  {
+    //times 1000 to get to seconds
+    pstats->dHashesPerSec = 1000.0 * (pstats->nHashes - pstats->nRateHashes) / (nNow - pstats->nRateStart);
+    pstats->nRateStart = nNow;
+    pstats->nRateHashes = pstats->nHashes;
+
+    dHashesPerSec = GetMinerHashesPerSec();
+    nHPSTimerStart = nNow;
+
+    //update with hashing speed information 30 secs
+    static volatile int64 nLogTime;
+    int64 nLogTimeLast = nLogTime;
+    if(GetTime() - nLogTimeLast > 30 && __sync_bool_compare_and_swap(&nLogTime, nLogTimeLast, GetTime()))
+    {
+      printf("%s ", DateTimeStrFormat(GetTime()).c_str());
+      printf("hashmeter %3d CPUs %6.0f hash/s\n", vnThreadsRunning[THREAD_MINER], dHashesPerSec);
+      printf("\tPoW Target: %s\n", hashTarget.ToString().c_str());
+    }
+  }
+}
+
 void heatMiner(CWallet *pwallet, bool fProofOfStake)
 {
   printf("CPUMiner started for proof-of-%s\n", fProofOfStake ? "stake" : "work");
@@ -5105,6 +6102,7 @@ void heatMiner(CWallet *pwallet, bool fProofOfStake)
   // Each thread has its own key and counter
   CReserveKey reservekey(pwallet);
   unsigned int nExtraNonce = 0;
+  CMinerStatsSlot statsSlot(!fProofOfStake);
 
   while(fGenerateheats || fProofOfStake)
   {
@@ -5113,7 +6111,7 @@ void heatMiner(CWallet *pwallet, bool fProofOfStake)
 
     while(vNodes.empty() || IsInitialBlockDownload())
     {
-      Sleep(1000);
+      WaitForTipChange(pindexBest, 1000);
       if(fShutdown)
         return;
       if((!fGenerateheats) && !fProofOfStake)
@@ -5127,20 +6125,19 @@ void heatMiner(CWallet *pwallet, bool fProofOfStake)
     }
     strMintWarning = "";
 
-    //
-    // Create new block
-    //
-    unsigned int nTransactionsUpdatedLast = nTransactionsUpdated;
-    CBlockIndex* pindexPrev = pindexBest;
+    if(fProofOfStake)
+    {
+      //
+      // Create new block
+      //
+      CBlockIndex* pindexPrev = pindexBest;
 
-    auto_ptr<CBlock> pblock(CreateNewBlock(pwallet, fProofOfStake));
-    if(!pblock.get())
-      return;
+      auto_ptr<CBlock> pblock(CreateNewBlock(pwallet, fProofOfStake));
+      if(!pblock.get())
+        return;
 
-    IncrementExtraNonce(pblock.get(), pindexPrev, nExtraNonce);
+      IncrementExtraNonce(pblock.get(), pindexPrev, nExtraNonce);
 
-    if(fProofOfStake)
-    {
       // heat: if proof-of-stake block found then process block
       if(pblock->IsProofOfStake())
       {
@@ -5157,51 +6154,69 @@ void heatMiner(CWallet *pwallet, bool fProofOfStake)
         SetThreadPriority(THREAD_PRIORITY_LOWEST);
       }
 
-      Sleep(500);
+      //the stake kernel depends on the time too, so try again after 500ms without a new block
+      WaitForTipChange(pindexPrev, 500);
       continue;
     }
 
-    printf("Running heatMiner with %d %s in block\n", 
-           pblock->vtx.size(), pblock->vtx.size() != 1 ? "transactions" : "transaction");
-
-
     //
-    // Prebuild hash buffers
+    // Take the shared template, this thread's copy only differs in extra nonce and time
     //
-    char pmidstatebuf[32+16]; char* pmidstate = alignup<16>(pmidstatebuf);
-    char pdatabuf[128+16];    char* pdata     = alignup<16>(pdatabuf);
-    char phash1buf[64+16];    char* phash1    = alignup<16>(phash1buf);
-
-    FormatHashBuffers(pblock.get(), pmidstate, pdata, phash1);
+    boost::shared_ptr<CMinerTemplate> ptemplate = GetMinerTemplate(pwallet);
+    if(!ptemplate)
+      return;
 
-    unsigned int& nBlockTime = *(unsigned int*)(pdata + 64 + 4);
-    unsigned int& nBlockNonce = *(unsigned int*)(pdata + 64 + 12);
+    CBlock block(ptemplate->block);
+    CBlockIndex* pindexPrev = ptemplate->pindexPrev;
+    unsigned int nBlockExtraNonce = 0;
 
 
     //
     // Search
     //
-    int64 nStart = GetTime();
-    uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+    uint256 hashTarget = CBigNum().SetCompact(block.nBits).getuint256();
     uint256 test_hash;
+    bool fFoundBlock = false;
 
-    for(;;)
+    while(!ptemplate->fStale)
     {
-      unsigned int nHashesDone = 0;
-      unsigned int nNonceFound;
+      u32int nUnit = __sync_fetch_and_add(&ptemplate->nNextUnit, 1);
+      if(nUnit / MINER_NONCE_CHUNKS + 1 != nBlockExtraNonce)
+      {
+        nBlockExtraNonce = nUnit / MINER_NONCE_CHUNKS + 1;
+        block.nTime = ptemplate->block.nTime;
+        SetExtraNonce(&block, nBlockExtraNonce);
+      }
+      block.nNonce = (nUnit % MINER_NONCE_CHUNKS) << 16;
+
+      // Update nTime every chunk
+      block.nTime = max(pindexPrev->GetMedianTimePast() + 1, block.GetMaxTransactionTime());
+      block.nTime = max(block.GetBlockTime(), pindexPrev->GetBlockTime() - nMaxClockDrift);
+      block.UpdateTime(pindexPrev);
 
-      nNonceFound = ScanDcryptHash(pblock.get(), &nHashesDone, &test_hash);
+      if(block.GetBlockTime() >= (int64)block.vtx[0].nTime + nMaxClockDrift)
+      {
+        ptemplate->fStale = true; // need to update coinbase timestamp
+        break;
+      }
 
-      // Check if something found
-      if(nNonceFound != (unsigned int) -1)
+      for(;;)
       {
+        unsigned int nHashesDone = 0;
+        uint64 nMixRounds = 0;
+        unsigned int nNonceFound = ScanDcryptHash(&block, &nHashesDone, &test_hash, &ptemplate->fStale, &nMixRounds);
+        MeterHashes(statsSlot.pstats, nHashesDone, nMixRounds, hashTarget);
+
+        // Check if something found
+        if(nNonceFound == (unsigned int) -1)
+          break;
 
         if(test_hash <= hashTarget)
         {
           // Found a solution!
-          assert(test_hash == pblock->GetHash());
+          assert(test_hash == block.GetHash());
 
-          if(!pblock->SignBlock(*pwalletMain))
+          if(!block.SignBlock(*pwalletMain))
           {
             strMintWarning = strMintMessage;
             break;
@@ -5209,43 +6224,12 @@ void heatMiner(CWallet *pwallet, bool fProofOfStake)
 
           strMintWarning = "";
           SetThreadPriority(THREAD_PRIORITY_NORMAL);
-          CheckWork(pblock.get(), *pwalletMain, reservekey);
+          CheckWork(&block, *pwalletMain, ptemplate->reservekey);
           SetThreadPriority(THREAD_PRIORITY_LOWEST);
-          break;
-        }
-      }
 
-      // Meter hashes/sec
-      static int64 nHashCounter;
-      if(!nHPSTimerStart)
-      {
-        nHPSTimerStart = GetTimeMillis();
-        nHashCounter = 0;
-      }else
-        nHashCounter += nHashesDone;
-
-      if(GetTimeMillis() - nHPSTimerStart > 4000)
-      {
-        static CCriticalSection cs;
-        {
-          LOCK(cs);
-          if(GetTimeMillis() - nHPSTimerStart > 4000)
-          {
-            //times 1000 to get to seconds
-            dHashesPerSec = 1000.0 * nHashCounter / (GetTimeMillis() - nHPSTimerStart);
-            nHPSTimerStart = GetTimeMillis();
-            nHashCounter = 0;
-            static int64 nLogTime;
-
-            //update with hashing speed information 30 secs
-            if(GetTime() - nLogTime > 30)
-            {
-              nLogTime = GetTime();
-              printf("%s ", DateTimeStrFormat(GetTime()).c_str());
-              printf("hashmeter %3d CPUs %6.0f hash/s\n", vnThreadsRunning[THREAD_MINER], dHashesPerSec);
-              printf("\tPoW Target: %s\n", hashTarget.ToString().c_str());
-            }
-          }
+          ptemplate->fStale = true;
+          fFoundBlock = true;
+          break;
         }
       }
 
@@ -5258,25 +6242,40 @@ void heatMiner(CWallet *pwallet, bool fProofOfStake)
         return;
       if(vNodes.empty())
         break;
-      if(nBlockNonce >= 0xffff0000)
-        break;
-      if(nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60)
-        break;
-      if(pindexPrev != pindexBest)
-        break;
-
-      // Update nTime every few seconds
-      pblock->nTime = max(pindexPrev->GetMedianTimePast() + 1, pblock->GetMaxTransactionTime());
-      pblock->nTime = max(pblock->GetBlockTime(), pindexPrev->GetBlockTime() - nMaxClockDrift);
-      pblock->UpdateTime(pindexPrev);
-      nBlockTime = ByteReverse(pblock->nTime);
-
-      if(pblock->GetBlockTime() >= (int64)pblock->vtx[0].nTime + nMaxClockDrift)
-        break;  // need to update coinbase timestamp
+      if(nTransactionsUpdated != ptemplate->nTransactionsUpdatedLast && GetTime() - ptemplate->nStart > 60)
+        ptemplate->fStale = true;
     }
+
+    if(ptemplate->fStale && !fFoundBlock && statsSlot.pstats)
+      __sync_fetch_and_add(&statsSlot.pstats->nStaleWork, (uint64)1);
   }
 }
 
+//
+// Tip change notification, lets the minters react to a new best block at once
+//
+
+static boost::mutex mutexTipChange;
+static boost::condition_variable condTipChange;
+
+void NotifyTipChanged()
+{
+  boost::lock_guard<boost::mutex> lock(mutexTipChange);
+  condTipChange.notify_all();
+}
+
+bool WaitForTipChange(const CBlockIndex *pindexLast, int64 nMilliseconds)
+{
+  boost::unique_lock<boost::mutex> lock(mutexTipChange);
+  boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(nMilliseconds);
+
+  while(pindexBest == pindexLast && !fShutdown)
+    if(!condTipChange.timed_wait(lock, timeout))
+      break;
+
+  return pindexBest != pindexLast;
+}
+
 void heatAfterBurner(CWallet *pwallet)
 {
   printf("CPUMiner started for proof-of-burn\n");
@@ -5286,6 +6285,7 @@ void heatAfterBurner(CWallet *pwallet)
   CReserveKey reservekey(pwallet);
   unsigned int nExtraNonce = 0;
   CBlockIndex *pindexLastBlock = NULL;
+  CBurnHashThreads burnHashThreads;
 
   for(;;)
   {
@@ -5294,7 +6294,7 @@ void heatAfterBurner(CWallet *pwallet)
 
     while(vNodes.empty() || IsInitialBlockDownload())
     {
-      Sleep(1000);
+      WaitForTipChange(pindexBest, 1000);
       if(fShutdown)
         return;
     }
@@ -5379,7 +6379,7 @@ void heatAfterBurner(CWallet *pwallet)
 
     }
 
-    Sleep(1);
+    WaitForTipChange(pindexLastBlock, 1000);
   }
   
   return;
@@ -11,6 +11,7 @@
 #include "bignum.h"
 #include "net.h"
 #include "script.h"
+#include "workqueue.h"
 #include <math.h>       /* pow */
 
 #ifdef WIN32
@@ -22,6 +23,7 @@
 //the size of the block to hash, from the nVersion to the nNonce
 #define HASH_PBLOCK_SIZE(pblock)  UEND(pblock->nNonce) - UBEGIN(pblock->nVersion)
 #define HASH_BLOCK_SIZE(block)    UEND(block.nNonce) - UBEGIN(block.nVersion)
+#define HASH_HEADER_SIZE          80 //what the two above come to
 
 class CWallet;
 class CBlock;
@@ -95,6 +97,7 @@ extern unsigned int nTransactionsUpdated;
 extern uint64 nLastBlockTx;
 extern uint64 nLastBlockSize;
 extern int64 nLastCoinStakeSearchInterval;
+extern bool fBurnIndex;
 extern const std::string strMessageMagic;
 extern double dHashesPerSec;
 extern int64 nHPSTimerStart;
@@ -106,6 +109,29 @@ extern std::map<uint256, CBlock*> mapOrphanBlocks;
 // Settings
 extern int64 nTransactionFee;
 
+// Mining statistics, reported by getminingstats
+#define MAX_MINER_STATS_THREADS 256
+
+/** Counters of one proof-of-work miner thread. Only that thread writes them and
+ *  each slot has a cache line to itself, so hashing threads never contend. */
+struct CMinerThreadStats
+{
+  volatile int fInUse;
+  volatile int64 nStartTime;     //when the thread took the slot
+  volatile uint64 nHashes;
+  volatile uint64 nMixRounds;    //dcrypt mix loop rounds run for those hashes
+  volatile uint64 nStaleWork;    //templates that went stale while the thread was on them
+  volatile double dHashesPerSec; //over the last few seconds
+
+  //only touched by the owning thread, the window dHashesPerSec is measured over
+  int64 nRateStart;
+  uint64 nRateHashes;
+} __attribute__((aligned(64)));
+
+extern CMinerThreadStats vMinerThreadStats[MAX_MINER_STATS_THREADS];
+extern volatile unsigned int nMinerTemplatesBuilt;
+extern volatile int64 nMinerTemplateTime;
+
 //////////////////////////////////////////////////////////////////////////////
 /*                              Proof Of Burn                               */
 //////////////////////////////////////////////////////////////////////////////
@@ -162,17 +188,56 @@ extern const uint64 POB_POS_TARGET_SWITCH_TIME;
 void heatAfterBurner(CWallet *pwallet);
 bool HashBurnData(uint256 burnBlockHash, uint256 hashPrevBlock, uint256 burnTxHash,
                   s32int burnBlkHeight, int64 burnValue, uint256 &smallestHashRet, bool fRetIntermediate);
+
+//GetBurnHash() and GetBurnSendersPubKey() remember what they work out in a bounded cache,
+// so a PoB block checked again, during reorganizes or when offered again, costs no disk reads
 bool GetBurnHash(uint256 hashPrevBlock, s32int burnBlkHeight, s32int burnCTx,
                  s32int burnCTxOut, uint256 &smallestHashRet, bool fRetIntermediate);
+bool GetBurnSendersPubKey(uint256 hashPrevBlock, s32int burnBlkHeight, s32int burnCTx,
+                          s32int burnCTxOut, CScript &scriptRet);
+bool IsBurnHashCached(uint256 hashPrevBlock, s32int burnBlkHeight, s32int burnCTx, s32int burnCTxOut);
 bool GetAllTxClassesByIndex(s32int blkHeight, s32int txDepth, s32int txOutDepth, 
-                            CBlock &blockRet, CTransaction &txRet, CTxOut &txOutRet);
+                            uint256 &hashBlockRet, CTransaction &txRet, CTxOut &txOutRet);
 
 //Scans all of the hashes of this transaction and returns the smallest one
 bool ScanBurnHashes(const CWalletTx &burnWTx, uint256 &smallestHashRet);
 
-//Applies ScanBurnHashes to all of the burnt hashes stored in the setBurnHashes
+//Finds the smallest of ScanBurnHashes over all of the burnt hashes stored in the setBurnHashes,
+// working from a cached table of burn candidates rather than the wallet transactions
 void HashAllBurntTx(uint256 &smallestHashRet, CWalletTx &smallestWTxRet);
 
+//A burn transaction's hashes projected over the PoW blocks still to come. The hashes of the
+// blocks to come are not known yet, so the best block's hash stands in for all of them,
+// only the decay changes from one step to the next
+struct CBurnSimulation
+{
+  uint256 hashTx;
+  uint256 hashBlock;  //the block holding the burn transaction
+  s32int nHeight;
+  int64 nValue;
+
+  //filled in by SimulateBurnHashes()
+  s32int nBetween;    //-1 while the burn transaction is in the best block itself
+  uint256 hashIntermediate;
+  std::vector<uint256> vHashes; //one per step, ~0 where it can not be hashed
+
+  //the PoW blocks between as HashBurnData() counts them with nStep more PoW blocks after the best one
+  s32int GetBetween(u32int nStep) const
+  {
+    return std::max(nBetween + (s32int)nStep, 0);
+  }
+};
+
+//Fills in the burn hashes of steps 0 through nHorizon, step 0 being the best block as it is,
+// spread across the burn hash threads, cs_main must be held
+void SimulateBurnHashes(std::vector<CBurnSimulation> &vSims, u32int nHorizon);
+
+//the nBurnBits of a PoB block mined after nPoWAhead more PoW blocks on top of pindexLast
+u32int GetProjectedBurnTarget(const CBlockIndex *pindexLast, u32int nPoWAhead);
+
+//Brings the -burnindex records in the txdb up to the best block, reading the blocks they are missing
+bool UpdateBurnStatsIndex();
+
 inline double calculate_burn_multiplier(int64 burnValue, s32int nPoWBlocksBetween)
 {
     return (BURN_CONSTANT / burnValue) * pow(2, (nPoWBlocksBetween - BURN_MIN_CONFIRMS) / BURN_HASH_DOUBLE);
@@ -232,6 +297,8 @@ inline const uint256 becomeCompact(const uint256 &num)
 class CReserveKey;
 class CTxDB;
 class CTxIndex;
+class CScriptCheck;
+class CNewBlockState;
 
 void RegisterWallet(CWallet* pwalletIn);
 void UnregisterWallet(CWallet* pwalletIn);
@@ -243,10 +310,21 @@ FILE* AppendBlockFile(unsigned int& nFileRet);
 bool LoadBlockIndex(bool fAllowNew=true);
 void PrintBlockTree();
 bool ProcessMessages(CNode* pfrom);
+void StartBlockCheckThreads();
+void StopBlockCheckThreads();
+void StartScriptCheckThreads();
+void StopScriptCheckThreads();
+void NotifyTipChanged();
+//waits up to nMilliseconds for pindexBest to move off pindexLast, true if it did
+bool WaitForTipChange(const CBlockIndex *pindexLast, int64 nMilliseconds);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 void Generateheats(bool fGenerate, CWallet* pwallet);
 CBlock *CreateNewBlock(CWallet* pwallet, bool fProofOfStake=false, 
-                       const CWalletTx *burnWalletTx=NULL, CReserveKey *resKey=NULL);
+                       const CWalletTx *burnWalletTx=NULL, CReserveKey *resKey=NULL,
+                       CNewBlockState *pstate=NULL);
+//adds the memory pool transactions that arrived since pblock was made by CreateNewBlock
+// with pstate, pblock must still build on pindexBest, returns the number added
+unsigned int AddToNewBlock(CBlock *pblock, CNewBlockState &state);
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 void FormatHashBuffers(CBlock* pblock, char* pmidstate, char* pdata, char* phash1);
 bool CheckWork(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey);
@@ -262,6 +340,7 @@ bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock);
 uint256 WantedByOrphan(const CBlock* pblockOrphan);
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 void heatMiner(CWallet *pwallet, bool fProofOfStake);
+void SetBestChainByHeight(CBlockIndex *pindexNew);
 CBlockIndex *pindexByHeight(s32int nHeight);
 
 //Returns the number of proof of work blocks between (not including) the
@@ -582,6 +661,11 @@ public:
   mutable int nDoS;
   bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
 
+  // memory only, see GetHash()
+  mutable bool fHashCacheable;
+  mutable bool fHashCached;
+  mutable uint256 hashCached;
+
   CTransaction()
   {
     SetNull();
@@ -589,12 +673,17 @@ public:
 
   IMPLEMENT_SERIALIZE
     (
+      //a read that throws part way leaves nothing cached
+      if(fRead)
+        fHashCacheable = fHashCached = false;
       READWRITE(this->nVersion);
       nVersion = this->nVersion;
       READWRITE(nTime);
       READWRITE(vin);
       READWRITE(vout);
       READWRITE(nLockTime);
+      if(fRead)
+        fHashCacheable = true;
       )
 
     void SetNull()
@@ -605,6 +694,7 @@ public:
     vout.clear();
     nLockTime = 0;
     nDoS = 0;  // Denial-of-service prevention
+    InvalidateHash();
   }
 
   bool IsNull() const
@@ -612,9 +702,28 @@ public:
     return (vin.empty() && vout.empty());
   }
 
+  //Transactions read off the network, the disk or the wallet (and copies of them)
+  // never change afterwards, so they hash only once. Built transactions are rehashed
+  // every time, a read one that gets changed must call InvalidateHash() first.
   uint256 GetHash() const
   {
-    return SerializeHash(*this);
+    if(fHashCached)
+      return hashCached;
+
+    uint256 hash = SerializeHash(*this);
+    if(fHashCacheable)
+    {
+      hashCached = hash;
+      fHashCached = true;
+    }
+    return hash;
+  }
+
+  //drops the cached hash, and stops caching it for this transaction
+  void InvalidateHash()
+  {
+    fHashCacheable = false;
+    fHashCached = false;
   }
 
   bool IsFinal(int nBlockHeight=0, int64 nBlockTime=0) const
@@ -947,11 +1056,13 @@ public:
       @param[in] fBlock	true if called from ConnectBlock
       @param[in] fMiner	true if called from CreateNewBlock
       @param[in] fStrictPayToScriptHash	true if fully validating p2sh transactions
+      @param[out] pvChecks	if given, the script checks are appended here instead of being run
       @return Returns true if all checks succeed
   */
   bool ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                      std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                     const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash=true);
+                     const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash=true,
+                     std::vector<CScriptCheck> *pvChecks=NULL);
   bool ClientConnectInputs();
   bool CheckTransaction() const;
   bool AcceptToMemoryPool(CTxDB& txdb, bool fCheckInputs=true, bool* pfMissingInputs=NULL);
@@ -1020,6 +1131,73 @@ CMerkleTx(const CTransaction& txIn) : CTransaction(txIn)
 
 
 
+/** One input's script check left over by ConnectInputs() for later, the
+ * spending transaction must outlive it, the script it spends is copied.
+ */
+class CScriptCheck
+{
+public:
+  CScript scriptPubKey;
+  const CTransaction *ptxTo;
+  unsigned int nIn;
+  bool fStrictPayToScriptHash;
+
+  CScriptCheck() : ptxTo(NULL), nIn(0), fStrictPayToScriptHash(false) {}
+  CScriptCheck(const CTxOut& txoutFrom, const CTransaction& txToIn, unsigned int nInIn, bool fStrictPayToScriptHashIn)
+    : scriptPubKey(txoutFrom.scriptPubKey), ptxTo(&txToIn), nIn(nInIn), fStrictPayToScriptHash(fStrictPayToScriptHashIn) {}
+
+  bool Verify(bool fStrict) const
+  {
+    return VerifyScript(ptxTo->vin[nIn].scriptSig, scriptPubKey, *ptxTo, nIn, fStrict, 0);
+  }
+  bool Verify() const { return Verify(fStrictPayToScriptHash); }
+};
+
+//script checks per work item, enough that queueing them costs little next to running them
+static const unsigned int SCRIPT_CHECK_CHUNK = 16;
+
+/** A run of script checks verified together on one of the script check threads */
+class CScriptCheckRange : public CWorkItem
+{
+public:
+  std::vector<CScriptCheck> vChecks;
+  const CScriptCheck *pcheckFailed;
+  bool fP2SHFailure; //passes without the strict p2sh rules
+  unsigned int nChecked; //checks run, up to and including a failed one
+
+  CScriptCheckRange() : pcheckFailed(NULL), fP2SHFailure(false), nChecked(0) {}
+
+  void Run();
+};
+
+/** The script checks of one block, split into ranges of SCRIPT_CHECK_CHUNK for
+ * the script check threads. Waits on all of them when it goes out of scope, so
+ * none is left running on the block's transactions whichever way
+ * ConnectBlock() returns.
+ */
+class CScriptCheckRanges
+{
+private:
+  std::list<CScriptCheckRange> listRanges; //list so the pushed ranges never move
+  std::vector<CScriptCheck> vPending;
+
+  void Push();
+
+public:
+  ~CScriptCheckRanges();
+
+  //takes the checks out of vChecks
+  void Add(std::vector<CScriptCheck> &vChecks);
+
+  //runs what is left, returns the first failed range or NULL if all passed
+  const CScriptCheckRange* Wait();
+
+  const std::list<CScriptCheckRange>& GetRanges() const { return listRanges; }
+};
+
+
+
+
 /**  A txdb record that contains the disk location of a transaction and the
  * locations of transactions that spend its outputs.  vSpent is really only
  * used as a flag, but having the location is very helpful for debugging.
@@ -1075,6 +1253,25 @@ public:
 };
 
 
+//running totals of the memory pool transactions collected into a new block,
+// mapTestPool holds every transaction in the block and the outputs they spend
+class CNewBlockState
+{
+public:
+  std::map<uint256, CTxIndex> mapTestPool;
+  uint64 nBlockSize;
+  uint64 nBlockTx;
+  int nBlockSigOps;
+
+  CNewBlockState()
+  {
+    nBlockSize = 1000;
+    nBlockTx = 0;
+    nBlockSigOps = 100;
+  }
+};
+
+
 
 
 
@@ -1118,6 +1315,14 @@ public:
   // memory only
   mutable std::vector<uint256> vMerkleTree;
 
+  // memory only, the header hashCached was computed from, see GetHash()
+  mutable bool fHashCached;
+  mutable uint256 hashCached;
+  mutable unsigned char pchHeaderCached[HASH_HEADER_SIZE];
+
+  // memory only, CheckBlock() already passed on a block check thread
+  mutable bool fChecked;
+
   // Denial-of-service detection:
   mutable int nDoS;
   bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
@@ -1181,6 +1386,8 @@ public:
     vtx.clear();
     vchBlockSig.clear();
     vMerkleTree.clear();
+    fHashCached = false;
+    fChecked = false;
     nDoS = 0;
   }
 
@@ -1189,9 +1396,19 @@ public:
     return (!nBits);
   }
 
+  //Dcrypt is expensive and a block is hashed many times on its way into the chain,
+  // so the hash is kept along with the header it came from. Changing any header
+  // field (the miner bumping nNonce, unserializing, etc.) makes the next call rehash.
   uint256 GetHash() const
   {
-    return DcryptHash(BEGIN(nVersion), END(nNonce));
+    if(fHashCached && !memcmp(pchHeaderCached, BEGIN(nVersion), HASH_HEADER_SIZE))
+      return hashCached;
+
+    hashCached = DcryptHash(BEGIN(nVersion), END(nNonce));
+    memcpy(pchHeaderCached, BEGIN(nVersion), HASH_HEADER_SIZE);
+    fHashCached = true;
+
+    return hashCached;
   }
 
   //PoB
@@ -1210,14 +1427,8 @@ public:
   //check this block's coinbase public key signature with that of the given transaction index
   bool BurnCheckPubKeys(s32int blkHeight, s32int txDepth, s32int txOutDepth) const
   {
-    CBlock indexBlock;
-    CTransaction indexTx;
-    CTxOut indexTxOut;
-    if(!GetAllTxClassesByIndex(blkHeight, txDepth, txOutDepth, indexBlock, indexTx, indexTxOut))
-      return false;
-
     CScript indexTxScript;
-    if(!indexTx.GetSendersPubKey(indexTxScript))
+    if(!GetBurnSendersPubKey(hashPrevBlock, blkHeight, txDepth, txOutDepth, indexTxScript))
       return false;
 
     //compare the block's coinbase's script with the burn transaction's sender's script
@@ -1473,6 +1684,9 @@ public:
   unsigned int nFile;
   unsigned int nBlockPos;
   CBigNum bnChainTrust; // heat: trust score of block chain
+  s32int nChainPoWBlocks; // proof-of-work blocks up to and including this one; in-memory only
+  CBlockIndex* pindexLastPoB; // latest proof-of-burn block up to and including this one; in-memory only
+  s32int nPoWSinceLastPoB; // proof-of-work blocks after pindexLastPoB up to this one; in-memory only
   int nHeight;
   int64 nMint;
   int64 nMoneySupply;
@@ -1519,6 +1733,9 @@ public:
     nBlockPos = 0;
     nHeight = 0;
     bnChainTrust = 0;
+    nChainPoWBlocks = 0;
+    pindexLastPoB = NULL;
+    nPoWSinceLastPoB = 0;
     nMint = 0;
     nMoneySupply = 0;
     nFlags = 0;
@@ -1553,6 +1770,9 @@ public:
     nBlockPos = nBlockPosIn;
     nHeight = 0;
     bnChainTrust = 0;
+    nChainPoWBlocks = 0;
+    pindexLastPoB = NULL;
+    nPoWSinceLastPoB = 0;
     nMint = 0;
     nMoneySupply = 0;
     nFlags = 0;
@@ -1614,6 +1834,21 @@ public:
 
   CBigNum GetBlockTrust() const;
 
+  //sets the in-memory counts carried forward from pprev, whose counts must be set
+  void SetChainCounts()
+  {
+    nChainPoWBlocks = (pprev ? pprev->nChainPoWBlocks : 0) + IsProofOfWork();
+
+    if(IsProofOfBurn())
+    {
+      pindexLastPoB = this;
+      nPoWSinceLastPoB = 0;
+    }else{
+      pindexLastPoB = pprev ? pprev->pindexLastPoB : NULL;
+      nPoWSinceLastPoB = (pprev ? pprev->nPoWSinceLastPoB : 0) + IsProofOfWork();
+    }
+  }
+
   bool IsInMainChain() const
   {
     return (pnext || this == pindexBest);
@@ -1778,6 +2013,7 @@ public:
   {
     hashPrev = (pprev ? pprev->GetBlockHash() : 0);
     hashNext = (pnext ? pnext->GetBlockHash() : 0);
+    blockHash = (phashBlock ? *phashBlock : 0);
   }
 
   IMPLEMENT_SERIALIZE
@@ -1827,11 +2063,22 @@ public:
       READWRITE(blockHash);
       )
 
-    uint256 GetBlockHash() const
+  //the hash is known when built from a live index or read back from disk,
+  // only records written before it was stored need the header rehashed
+  uint256 GetBlockHash() const
   {
-    if(fUseFastIndex && (nTime < GetAdjustedTime() - 24 * 60 * 60) && blockHash != 0)
+    if(blockHash != 0)
       return blockHash;
 
+    //assign the cached value to be written a value
+    const_cast<CDiskBlockIndex*>(this)->blockHash = CalcBlockHash();
+
+    return blockHash;
+  }
+
+  //always runs Dcrypt over the stored header
+  uint256 CalcBlockHash() const
+  {
     CBlock block;
     block.nVersion        = nVersion;
     block.hashPrevBlock   = hashPrev;
@@ -1840,10 +2087,7 @@ public:
     block.nBits           = nBits;
     block.nNonce          = nNonce;
 
-    //assign the cached value to be written a value
-    const_cast<CDiskBlockIndex*>(this)->blockHash = block.GetHash();
-
-    return blockHash;
+    return block.GetHash();
   }
 
 
@@ -1865,6 +2109,58 @@ public:
 };
 
 
+/** Proof-of-burn figures of one main chain block, kept by height in the txdb
+ * when -burnindex is set so they can be queried without reading the blocks
+ */
+class CBurnStats
+{
+public:
+  uint256 hashBlock;
+  int64 nBurnedCoins;       //burnt by this block's transactions
+  int64 nTotalBurnedCoins;  //burnt by this block and every block before it
+  int64 nEffectiveBurnCoins;
+  u32int nBurnBits;
+
+  //the burn transaction a proof-of-burn block was won with, -1 otherwise
+  s32int burnBlkHeight;
+  s32int burnCTx;
+  s32int burnCTxOut;
+  uint256 burnHash;
+
+  CBurnStats()
+  {
+    SetNull();
+  }
+
+  IMPLEMENT_SERIALIZE
+    (
+      READWRITE(hashBlock);
+      READWRITE(nBurnedCoins);
+      READWRITE(nTotalBurnedCoins);
+      READWRITE(nEffectiveBurnCoins);
+      READWRITE(nBurnBits);
+      READWRITE(burnBlkHeight);
+      READWRITE(burnCTx);
+      READWRITE(burnCTxOut);
+      READWRITE(burnHash);
+      )
+
+  void SetNull()
+  {
+    hashBlock = 0;
+    nBurnedCoins = nTotalBurnedCoins = nEffectiveBurnCoins = 0;
+    nBurnBits = 0;
+    burnBlkHeight = burnCTx = burnCTxOut = -1;
+    burnHash = 0;
+  }
+
+  bool IsProofOfBurn() const
+  {
+    return burnBlkHeight >= 0;
+  }
+};
+
+
 
 
 
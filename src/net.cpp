@@ -1681,6 +1681,12 @@ void StartNode(void* parg)
   if(!CreateThread(ThreadOpenConnections, NULL))
     printf("Error: CreateThread(ThreadOpenConnections) failed\n");
 
+  // Check blocks ahead of the message handler
+  StartBlockCheckThreads();
+
+  // Verify the scripts of connected blocks side by side
+  StartScriptCheckThreads();
+
   // Process messages
   if(!CreateThread(ThreadMessageHandler, NULL))
     printf("Error: CreateThread(ThreadMessageHandler) failed\n");
@@ -1712,6 +1718,9 @@ bool StopNode()
   if(semOutbound)
     for(int i=0; i<MAX_OUTBOUND_CONNECTIONS; i++)
       semOutbound->post();
+  StopBlockCheckThreads();
+  StopScriptCheckThreads();
+  NotifyTipChanged();
   do
   {
     int nThreadsRunning = 0;
@@ -1730,13 +1739,15 @@ bool StopNode()
   if(vnThreadsRunning[THREAD_MINER] > 0)             printf("ThreadheatMiner still running\n");
   if(vnThreadsRunning[THREAD_BURNER] > 0)            printf("ThreadAfterBurner still running\n");
   if(vnThreadsRunning[THREAD_RPCSERVER] > 0)         printf("ThreadRPCServer still running\n");
+  if(vnThreadsRunning[THREAD_RPCHANDLER] > 0)        printf("ThreadRPCConnection still running\n");
   if(fHaveUPnP && vnThreadsRunning[THREAD_UPNP] > 0) printf("ThreadMapPort still running\n");
   if(vnThreadsRunning[THREAD_DNSSEED] > 0)           printf("ThreadDNSAddressSeed still running\n");
   if(vnThreadsRunning[THREAD_ADDEDCONNECTIONS] > 0)  printf("ThreadOpenAddedConnections still running\n");
   if(vnThreadsRunning[THREAD_DUMPADDRESS] > 0)       printf("ThreadDumpAddresses still running\n");
   if(vnThreadsRunning[THREAD_MINTER] > 0)            printf("ThreadStakeMinter still running\n");
 
-  while(vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCSERVER] > 0)
+  while(vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCSERVER] > 0 ||
+        vnThreadsRunning[THREAD_RPCHANDLER] > 0)
     Sleep(20);
 
   Sleep(50);
@@ -83,6 +83,7 @@ enum threadId
   THREAD_DUMPADDRESS,
   THREAD_MINTER,
   THREAD_BURNER,
+  THREAD_RPCHANDLER,
 
   THREAD_MAX
 };
@@ -5,7 +5,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include <boost/foreach.hpp>
-#include <boost/tuple/tuple.hpp>
+#include <boost/thread/tss.hpp>
 
 using namespace std;
 using namespace boost;
@@ -1110,34 +1110,62 @@ uint256 SignatureHash(CScript scriptCode, const CTransaction &txTo, unsigned int
 class CSignatureCache
 {
 private:
-  // sigdata_type is (signature hash, signature, public key):
-  typedef boost::tuple<uint256, std::vector<unsigned char>, std::vector<unsigned char> > sigdata_type;
-  std::set< sigdata_type> setValid;
+  // heat: entries are one hash of (signature hash, public key, signature) salted
+  // per run, so an entry is a fixed 32 bytes and a lookup copies nothing
+  uint256 hashSalt;
+  std::set<uint256> setValid;
+  uint64 nHits;
   CCriticalSection cs_sigcache;
 
+  uint256 GetEntry(const uint256 &hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey) const
+  {
+    CDataStream ss(SER_GETHASH, 0);
+    ss << hashSalt << hash << pubKey << vchSig;
+    return Hash(ss.begin(), ss.end());
+  }
+
 public:
+  CSignatureCache() : hashSalt(GetRandHash()), nHits(0) {}
+
+  bool
+  Contains(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
+  {
+    uint256 entry = GetEntry(hash, vchSig, pubKey);
+
+    LOCK(cs_sigcache);
+    return setValid.count(entry) > 0;
+  }
+
   bool
   Get(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
   {
+    uint256 entry = GetEntry(hash, vchSig, pubKey);
+
     LOCK(cs_sigcache);
+    if(!setValid.count(entry))
+      return false;
+    nHits++;
+    return true;
+  }
 
-    sigdata_type k(hash, vchSig, pubKey);
-    std::set<sigdata_type>::iterator mi = setValid.find(k);
-    if(mi != setValid.end())
-      return true;
-    return false;
+  uint64 GetHits()
+  {
+    LOCK(cs_sigcache);
+    return nHits;
   }
 
   void
   Set(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
   {
-    // DoS prevention: limit cache size to less than 10MB
-    // (~200 bytes per cache entry times 50,000 entries)
+    // DoS prevention: limit cache size to less than 5MB
+    // (~80 bytes per cache entry times 50,000 entries)
     // Since there are a maximum of 20,000 signature operations per block
     // 50,000 is a reasonable default.
     int64 nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
     if(nMaxCacheSize <= 0) return;
 
+    uint256 entry = GetEntry(hash, vchSig, pubKey);
+
     LOCK(cs_sigcache);
 
     while(static_cast<int64>(setValid.size()) > nMaxCacheSize)
@@ -1146,24 +1174,41 @@ public:
       // foil would-be DoS attackers who might try to pre-generate
       // and re-use a set of valid signatures just-slightly-greater
       // than our cache size.
-      uint256 randomHash = GetRandHash();
-      std::vector<unsigned char> unused;
-      std::set<sigdata_type>::iterator it =
-        setValid.lower_bound(sigdata_type(randomHash, unused, unused));
+      std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
       if(it == setValid.end())
         it = setValid.begin();
-      setValid.erase(*it);
+      setValid.erase(it);
     }
 
-    sigdata_type k(hash, vchSig, pubKey);
-    setValid.insert(k);
+    setValid.insert(entry);
   }
 };
 
+//the key CheckSig() loads each public key into, one per thread so the script check
+// threads don't share it, and reused so a check doesn't allocate an EC_KEY
+static boost::thread_specific_ptr<CKey> pCheckSigKey;
+
+static CSignatureCache &GetSignatureCache()
+{
+  static CSignatureCache signatureCache;
+  return signatureCache;
+}
+
+//for the tests, whether CheckSig() has a signature cached and how often it found one
+bool IsSignatureCached(const uint256 &sighash, const vector<unsigned char> &vchSig, const vector<unsigned char> &vchPubKey)
+{
+  return GetSignatureCache().Contains(sighash, vchSig, vchPubKey);
+}
+
+uint64 GetSignatureCacheHits()
+{
+  return GetSignatureCache().GetHits();
+}
+
 bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CScript scriptCode,
               const CTransaction& txTo, unsigned int nIn, int nHashType)
 {
-  static CSignatureCache signatureCache;
+  CSignatureCache &signatureCache = GetSignatureCache();
 
   // Hash type is one byte tacked on to the end of the signature
   if(vchSig.empty())
@@ -1179,7 +1224,9 @@ bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CSc
   if(signatureCache.Get(sighash, vchSig, vchPubKey))
     return true;
 
-  CKey key;
+  if(!pCheckSigKey.get())
+    pCheckSigKey.reset(new CKey());
+  CKey &key = *pCheckSigKey;
   if(!key.SetPubKey(vchPubKey))
     return false;
 
@@ -1595,6 +1642,7 @@ bool SignSignature(const CKeyStore &keystore, const CScript &fromPubKey,
 {
   assert(nIn < txTo.vin.size());
   CTxIn& txin = txTo.vin[nIn];
+  txTo.InvalidateHash(); //the scriptSig is written below
 
   // Leave out the signature from the hash, since a signature can't sign itself.
   // The checksig op will also drop the signatures from its hash.
@@ -1631,6 +1679,7 @@ bool SignSignature(const CKeyStore &keystore, const CTransaction &txFrom,
 {
   assert(nIn < txTo.vin.size());
   CTxIn &txin = txTo.vin[nIn];
+  txTo.InvalidateHash(); //the scriptSig is written below
   assert(txin.prevout.n < txFrom.vout.size());
   assert(txin.prevout.hash == txFrom.GetHash());
   const CTxOut &txout = txFrom.vout[txin.prevout.n];
@@ -7,32 +7,29 @@
 
 #include "sha256.h"
 
-static void digest_to_string(u8int *hash_digest, u8int *string)
-{
-  register u8int tmp_val;
+//every byte value written out as its two lowercase hex chars
+static const char hex_pairs[] =
+  "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+  "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+  "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+  "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+  "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+  "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+  "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+  "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
 
+void sha256_digest_to_hex(const u8int *hash_digest, u8int *string)
+{
   uint32_t i = 0;
   for(; i < SHA256_DIGEST_LENGTH; i++)
-  {
-    //format the most (left-most) significant 4bit hex
-    tmp_val = *(hash_digest + i) >> 4;
+    memcpy(string + (i * 2), hex_pairs + (*(hash_digest + i) * 2), 2);
 
-    //get the integer into a char
-    if(tmp_val <= 9)
-      *(string + (i * 2)) = tmp_val + '0';
-    else //add 87 to get the integer into the a-f of a hex
-      *(string + (i * 2)) = tmp_val + 87; //ex: if tmp_val == 10 (0xa) then + 87 equals char 'a'
-
-    //format the least (right-most) significant 4bit hex
-    tmp_val = *(hash_digest + i) & 0x0F;
-
-    //get the integer into a char
-    if(tmp_val <= 9)
-      *(string + (i * 2) + 1) = tmp_val + '0';
-    else //add 87 to get the integer into the a-f of a hex
-      *(string + (i * 2) + 1) = tmp_val + 87; //ex: if tmp_val == 10 (0xa) then + 87 equals char 'a'
+  return;
+}
 
-  }
+static void digest_to_string(u8int *hash_digest, u8int *string)
+{
+  sha256_digest_to_hex(hash_digest, string);
 
   //add the termination \000 to the string
   *(string + SHA256_LEN) = 0;
@@ -92,3 +89,194 @@ void sha256_salt_to_str(const u8int *data, size_t data_sz, u8int *salt, size_t s
   //sucess!
   return;
 }
+
+//////////////////////////////////////////////////////////////////////////////
+/*                          Multi-buffer sha256                             */
+//////////////////////////////////////////////////////////////////////////////
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t sha256_init_state[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t be32(const u8int *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+//the compression rounds, written once for plain words and for each vector width,
+// ROTR, SHR and the + and logic operators are all the lane type's own
+#define SHA256_ROTR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA256_CH(x, y, z)  ((z) ^ ((x) & ((y) ^ (z))))
+#define SHA256_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define SHA256_S0(x)        (SHA256_ROTR(x, 2) ^ SHA256_ROTR(x, 13) ^ SHA256_ROTR(x, 22))
+#define SHA256_S1(x)        (SHA256_ROTR(x, 6) ^ SHA256_ROTR(x, 11) ^ SHA256_ROTR(x, 25))
+#define SHA256_s0(x)        (SHA256_ROTR(x, 7) ^ SHA256_ROTR(x, 18) ^ ((x) >> 3))
+#define SHA256_s1(x)        (SHA256_ROTR(x, 17) ^ SHA256_ROTR(x, 19) ^ ((x) >> 10))
+
+//one round with the working variables passed in rotated order, w[i] is expanded
+// in place once the first 16 rounds have used the message words
+#define SHA256_ROUND(T, a, b, c, d, e, f, g, h, i, t, w)                     \
+  {                                                                           \
+    if(t)                                                                     \
+      w[i] += SHA256_s1(w[(i + 14) & 15]) + w[(i + 9) & 15] + SHA256_s0(w[(i + 1) & 15]); \
+    T t1 = h + SHA256_S1(e) + SHA256_CH(e, f, g) + sha256_k[t + i] + w[i];    \
+    d += t1;                                                                  \
+    h = t1 + SHA256_S0(a) + SHA256_MAJ(a, b, c);                              \
+  }
+
+#define SHA256_ROUNDS(T, w, s)                                                \
+  {                                                                           \
+    T a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7]; \
+    for(int t = 0; t < 64; t += 16)                                           \
+    {                                                                         \
+      SHA256_ROUND(T, a, b, c, d, e, f, g, h, 0, t, w);                       \
+      SHA256_ROUND(T, h, a, b, c, d, e, f, g, 1, t, w);                       \
+      SHA256_ROUND(T, g, h, a, b, c, d, e, f, 2, t, w);                       \
+      SHA256_ROUND(T, f, g, h, a, b, c, d, e, 3, t, w);                       \
+      SHA256_ROUND(T, e, f, g, h, a, b, c, d, 4, t, w);                       \
+      SHA256_ROUND(T, d, e, f, g, h, a, b, c, 5, t, w);                       \
+      SHA256_ROUND(T, c, d, e, f, g, h, a, b, 6, t, w);                       \
+      SHA256_ROUND(T, b, c, d, e, f, g, h, a, 7, t, w);                       \
+      SHA256_ROUND(T, a, b, c, d, e, f, g, h, 8, t, w);                       \
+      SHA256_ROUND(T, h, a, b, c, d, e, f, g, 9, t, w);                       \
+      SHA256_ROUND(T, g, h, a, b, c, d, e, f, 10, t, w);                      \
+      SHA256_ROUND(T, f, g, h, a, b, c, d, e, 11, t, w);                      \
+      SHA256_ROUND(T, e, f, g, h, a, b, c, d, 12, t, w);                      \
+      SHA256_ROUND(T, d, e, f, g, h, a, b, c, 13, t, w);                      \
+      SHA256_ROUND(T, c, d, e, f, g, h, a, b, 14, t, w);                      \
+      SHA256_ROUND(T, b, c, d, e, f, g, h, a, 15, t, w);                      \
+    }                                                                         \
+    s[0] += a; s[1] += b; s[2] += c; s[3] += d;                               \
+    s[4] += e; s[5] += f; s[6] += g; s[7] += h;                               \
+  }
+
+void sha256_transform(uint32_t *state, const u8int *block)
+{
+  uint32_t w[16];
+  for(int t = 0; t < 16; t++)
+    w[t] = be32(block + t * 4);
+
+  SHA256_ROUNDS(uint32_t, w, state);
+}
+
+static void sha256_transform_scalar(uint32_t (*states)[8], const u8int *const *blocks, u32int nLanes)
+{
+  for(u32int i = 0; i < nLanes; i++)
+    sha256_transform(states[i], blocks[i]);
+}
+
+//one vector per state or message word, lane j of each vector belongs to blocks[j],
+// lanes past nLanes hash a copy of the first block and are thrown away. The words
+// are transposed through plain arrays, element by element vector inserts are slow
+#define SHA256_TRANSFORM_LANES(name, T, N)                                    \
+  static void name(uint32_t (*states)[8], const u8int *const *blocks, u32int nLanes) \
+  {                                                                           \
+    uint32_t wt[16][N], st[8][N];                                             \
+    T w[16], s[8];                                                            \
+    for(u32int j = 0; j < N; j++)                                             \
+    {                                                                         \
+      const u8int *block = blocks[j < nLanes ? j : 0];                        \
+      const uint32_t *state = states[j < nLanes ? j : 0];                     \
+      for(int t = 0; t < 16; t++)                                             \
+        wt[t][j] = be32(block + t * 4);                                       \
+      for(int i = 0; i < 8; i++)                                              \
+        st[i][j] = state[i];                                                  \
+    }                                                                         \
+    memcpy(w, wt, sizeof(w));                                                 \
+    memcpy(s, st, sizeof(s));                                                 \
+    SHA256_ROUNDS(T, w, s);                                                   \
+    memcpy(st, s, sizeof(s));                                                 \
+    for(u32int j = 0; j < nLanes; j++)                                        \
+      for(int i = 0; i < 8; i++)                                              \
+        states[j][i] = st[i][j];                                              \
+  }
+
+#ifdef USE_SHA256_LANES
+#include <cpuid.h>
+
+//the sha extensions make openssl's single stream faster than any lane count
+static bool cpu_has_sha_ext()
+{
+  unsigned int a, b, c, d;
+  if(__get_cpuid_max(0, 0) < 7)
+    return false;
+
+  __cpuid_count(7, 0, a, b, c, d);
+  return b & (1 << 29);
+}
+
+typedef uint32_t sha256_v4 __attribute__((vector_size(16)));
+typedef uint32_t sha256_v8 __attribute__((vector_size(32)));
+typedef uint32_t sha256_v16 __attribute__((vector_size(64)));
+
+__attribute__((target("sse4.1")))
+SHA256_TRANSFORM_LANES(sha256_transform_sse41, sha256_v4, 4)
+
+__attribute__((target("avx2")))
+SHA256_TRANSFORM_LANES(sha256_transform_avx2, sha256_v8, 8)
+
+__attribute__((target("avx512f")))
+SHA256_TRANSFORM_LANES(sha256_transform_avx512, sha256_v16, 16)
+#endif
+
+typedef void (*sha256_lanes_fn)(uint32_t (*states)[8], const u8int *const *blocks, u32int nLanes);
+
+static sha256_lanes_fn sha256_transform_width = sha256_transform_scalar;
+static u32int sha256_width = 1;
+static bool fSHA256LanesInit = false;
+
+u32int sha256_lanes_init(u32int nMaxLanes)
+{
+  sha256_transform_width = sha256_transform_scalar;
+  sha256_width = 1;
+
+#ifdef USE_SHA256_LANES
+  __builtin_cpu_init();
+  if(nMaxLanes == SHA256_LANES_AUTO)
+    nMaxLanes = cpu_has_sha_ext() ? 1 : SHA256_MAX_LANES;
+
+  if(nMaxLanes >= 16 && __builtin_cpu_supports("avx512f"))
+  {
+    sha256_transform_width = sha256_transform_avx512;
+    sha256_width = 16;
+  }else if(nMaxLanes >= 8 && __builtin_cpu_supports("avx2"))
+  {
+    sha256_transform_width = sha256_transform_avx2;
+    sha256_width = 8;
+  }else if(nMaxLanes >= 4 && __builtin_cpu_supports("sse4.1"))
+  {
+    sha256_transform_width = sha256_transform_sse41;
+    sha256_width = 4;
+  }
+#endif
+
+  fSHA256LanesInit = true;
+  return sha256_width;
+}
+
+u32int sha256_lanes()
+{
+  if(!fSHA256LanesInit)
+    sha256_lanes_init();
+
+  return sha256_width;
+}
+
+void sha256_transform_lanes(uint32_t (*states)[8], const u8int *const *blocks, u32int nLanes)
+{
+  const u32int nWidth = sha256_lanes();
+
+  for(u32int i = 0; i < nLanes; i += nWidth)
+    sha256_transform_width(states + i, blocks + i, std::min(nWidth, nLanes - i));
+}
@@ -10,6 +10,9 @@
  
 #define SHA256_LEN           64 //64 bytes the for the hash itself
 
+//writes the 64 lowercase hex chars of a sha256 digest to outputBuffer, no \000 is added
+void sha256_digest_to_hex(const u8int *hash_digest, u8int *outputBuffer);
+
 //the intermediate sha256 hashing algoritm
 void sha256_to_str(const u8int *data, size_t data_sz, u8int *outputBuffer, u8int *hash_digest);
 uint256 sha256(const u8int *data, size_t data_sz, uint256 *hash_digest = 0);
@@ -17,4 +20,29 @@ uint256 sha256(const u8int *data, size_t data_sz, uint256 *hash_digest = 0);
 void sha256_salt_to_str(const u8int *data, size_t data_sz, u8int *salt, size_t salt_sz, 
                         u8int *outputBuffer, u8int *hash_digest);
 
+//Multi-buffer sha256: the same compression run on several independent states at
+// once, one per SIMD lane. The widest of SSE4.1 (4), AVX2 (8) and AVX-512 (16) lanes
+// the cpu has is picked at runtime, other cpus fall back to one state at a time.
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define USE_SHA256_LANES
+#endif
+
+#define SHA256_MAX_LANES  16
+#define SHA256_LANES_AUTO 0   //widest lanes, unless the cpu has sha instructions
+
+extern const uint32_t sha256_init_state[8];
+
+//one sha256 compression of a 64 byte block into state
+void sha256_transform(uint32_t *state, const u8int *block);
+
+//compresses blocks[i] into states[i] for every i < nLanes, nLanes may be anything
+void sha256_transform_lanes(uint32_t (*states)[8], const u8int *const *blocks, u32int nLanes);
+
+//number of lanes sha256_transform_lanes runs side by side
+u32int sha256_lanes();
+
+//picks the widest lane count the cpu supports that is no more than nMaxLanes, returns it
+u32int sha256_lanes_init(u32int nMaxLanes = SHA256_LANES_AUTO);
+
 #endif
@@ -0,0 +1,169 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+
+BOOST_AUTO_TEST_SUITE(bestchain_tests)
+
+//a main chain with heights 0-19 and a branch off height 10 up to height 14,
+// static so the best chain lookups never point at freed indexes
+static CBlockIndex vMainChain[20];
+static CBlockIndex vBranch[4];
+
+//every third block is proof-of-stake, every fifth proof-of-burn
+static void SetupIndex(CBlockIndex &index, CBlockIndex *pprev, int nKind)
+{
+  index.pprev = pprev;
+  index.nHeight = pprev ? pprev->nHeight + 1 : 0;
+
+  if(nKind % 3 == 0)
+    index.SetProofOfStake();
+  else if(nKind % 5 == 0)
+  {
+    index.fProofOfBurn = true;
+    index.burnBlkHeight = index.burnCTx = index.burnCTxOut = 0;
+  }
+
+  index.SetChainCounts();
+}
+
+static void BuildChains()
+{
+  for(int i = 0; i < 20; i++)
+    SetupIndex(vMainChain[i], i ? &vMainChain[i - 1] : NULL, i);
+
+  //the branch's block kinds differ from the main chain's
+  for(int i = 0; i < 4; i++)
+    SetupIndex(vBranch[i], i ? &vBranch[i - 1] : &vMainChain[10], i + 1);
+}
+
+//nPoWBlocksBetween() as it was before the counts were kept in the index
+static s32int PoWBlocksBetweenWalk(s32int startHeight, s32int endHeight)
+{
+  if(startHeight >= endHeight || startHeight < 0 || endHeight < 0)
+    return 0;
+
+  s32int between = 0;
+  CBlockIndex *pindex = pindexByHeight(endHeight);
+  for(; pindex && pindex->pprev && pindex->pprev->nHeight > startHeight; pindex = pindex->pprev)
+  {
+    if(pindex->IsProofOfWork())
+      between++;
+  }
+
+  if(!pindex || !pindex->pprev)
+    return 0;
+
+  return between;
+}
+
+static void CheckPoWBlocksBetween()
+{
+  for(int nStart = -1; nStart < 22; nStart++)
+    for(int nEnd = -1; nEnd < 22; nEnd++)
+      BOOST_CHECK_EQUAL(nPoWBlocksBetween(nStart, nEnd), PoWBlocksBetweenWalk(nStart, nEnd));
+}
+
+static void SetBest(CBlockIndex *pindex)
+{
+  SetBestChainByHeight(pindex);
+  pindexBest = pindex;
+}
+
+BOOST_AUTO_TEST_CASE(bestchain_by_height)
+{
+  CBlockIndex *pindexBestOld = pindexBest;
+  BuildChains();
+
+  SetBest(&vMainChain[19]);
+  for(int i = 1; i < 20; i++)
+    BOOST_CHECK(pindexByHeight(i) == &vMainChain[i]);
+
+  //the genesis block and heights past the tip are not found
+  BOOST_CHECK(pindexByHeight(0) == NULL);
+  BOOST_CHECK(pindexByHeight(20) == NULL);
+  BOOST_CHECK(pindexByHeight(-1) == NULL);
+
+  //reorganize onto the shorter branch
+  SetBest(&vBranch[3]);
+  for(int i = 1; i <= 10; i++)
+    BOOST_CHECK(pindexByHeight(i) == &vMainChain[i]);
+  for(int i = 11; i <= 14; i++)
+    BOOST_CHECK(pindexByHeight(i) == &vBranch[i - 11]);
+  BOOST_CHECK(pindexByHeight(15) == NULL);
+
+  //and back
+  SetBest(&vMainChain[19]);
+  for(int i = 1; i < 20; i++)
+    BOOST_CHECK(pindexByHeight(i) == &vMainChain[i]);
+
+  SetBest(&vMainChain[0]);
+  pindexBest = pindexBestOld;
+}
+
+BOOST_AUTO_TEST_CASE(bestchain_pow_blocks_between)
+{
+  CBlockIndex *pindexBestOld = pindexBest;
+  BuildChains();
+
+  SetBest(&vMainChain[19]);
+  CheckPoWBlocksBetween();
+
+  //heights 2, 4, 7 and 8 are the proof-of-work blocks counted
+  BOOST_CHECK_EQUAL(nPoWBlocksBetween(0, 10), 4);
+
+  SetBest(&vBranch[3]);
+  CheckPoWBlocksBetween();
+
+  SetBest(&vMainChain[0]);
+  pindexBest = pindexBestOld;
+}
+
+BOOST_AUTO_TEST_CASE(bestchain_last_pob)
+{
+  BuildChains();
+
+  //against the walk GetNextBurnTargetRequired() used to do
+  for(int i = 0; i < 24; i++)
+  {
+    const CBlockIndex *pindexLast = i < 20 ? &vMainChain[i] : &vBranch[i - 20];
+
+    s32int nPoW = 0;
+    const CBlockIndex *pindex = pindexLast;
+    for(; pindex && !pindex->IsProofOfBurn(); pindex = pindex->pprev)
+      if(pindex->IsProofOfWork())
+        nPoW++;
+
+    BOOST_CHECK(pindexLast->pindexLastPoB == pindex);
+    if(pindex)
+      BOOST_CHECK_EQUAL(pindexLast->nPoWSinceLastPoB, nPoW);
+  }
+
+  BOOST_CHECK(vMainChain[4].pindexLastPoB == NULL);
+  BOOST_CHECK(vMainChain[14].pindexLastPoB == &vMainChain[10]);
+  BOOST_CHECK_EQUAL(vMainChain[14].nPoWSinceLastPoB, 3);
+  BOOST_CHECK(vBranch[3].pindexLastPoB == &vMainChain[10]);
+  BOOST_CHECK_EQUAL(vBranch[3].nPoWSinceLastPoB, 3);
+}
+
+BOOST_AUTO_TEST_CASE(bestchain_projected_burn_target)
+{
+  BuildChains();
+
+  //past the switch to the new burn target protocol
+  for(int i = 0; i < 20; i++)
+    vMainChain[i].nTime = POB_POS_TARGET_SWITCH_TIME + 1;
+  vMainChain[10].nBurnBits = CBigNum(~uint256(0) >> 40).GetCompact();
+
+  //projecting ahead over PoW blocks gives the target once they are there, heights 11, 13 and 14
+  // are PoW and 12 is PoS
+  BOOST_CHECK_EQUAL(GetProjectedBurnTarget(&vMainChain[11], 2), GetProjectedBurnTarget(&vMainChain[14], 0));
+  BOOST_CHECK_EQUAL(GetProjectedBurnTarget(&vMainChain[10], 3), GetProjectedBurnTarget(&vMainChain[14], 0));
+  BOOST_CHECK_EQUAL(GetProjectedBurnTarget(&vMainChain[13], 1), GetProjectedBurnTarget(&vMainChain[14], 0));
+
+  //every PoW block without a PoB block makes it easier
+  for(u32int i = 0; i < 10; i++)
+    BOOST_CHECK(CBigNum().SetCompact(GetProjectedBurnTarget(&vMainChain[14], i + 1)) >=
+                CBigNum().SetCompact(GetProjectedBurnTarget(&vMainChain[14], i)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,237 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include "uint256.h"
+#include "util.h"
+#include "dcrypt.h"
+
+BOOST_AUTO_TEST_SUITE(dcrypt_tests)
+
+//fills an 80 byte block header with deterministic junk
+static void FillHeader(u8int *header, u32int &seed)
+{
+  for(int i = 0; i < 80; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    header[i] = seed >> 16;
+  }
+}
+
+//The anchors below were made with the dcrypt of the tree before the scratch arena,
+// streaming and raw digest changes, the one that mixed hex strings. dcrypt_reference
+// is the arena version and is only tied to that original through these anchors, so
+// they must never be regenerated from the current code.
+
+//the first headers FillHeader() makes from seed 12345
+static const char *pszHeaderHashes[] = {
+  "c25a7ee20366907c511f7af278a9734652ac764d96db57fd1c1c0d126b724840",
+  "23a848d6283a188138a2dddaeb7783ad137f3e987dab4921c08a9815e75119f1",
+  "fd4dfacf0afc2064b0429a96089d961119edd807d89705b2ad497218a9cc49c1",
+  "e0dc45fe4d3ad7fee229dcf7b8cf0d10d73b863594d9c9b1ab1df80e338961b0",
+  "3d221e2b49b8b5f90cc1de5ef4944d71c8761f03c2a518bdf9f619a75124a725",
+  "bc61b92148e32bb08a070b02e00b1ffbfca0504224921ccc3519840256c803ab",
+  "edcb80732e63e00fdb2883434559368675738505dd7acc798463fc32735d984b",
+  "2d07b8e8dfc18e7e277b892965dd47478c4c7ee3ac43a0075907e891bcf7e10a",
+};
+
+static const int nHeaderHashes = sizeof(pszHeaderHashes) / sizeof(pszHeaderHashes[0]);
+
+//the first headers FillHeader() makes from seed 54321, cut to the length given
+static const struct
+{
+  size_t nLen;
+  const char *pszHash;
+} lengthHashes[] = {
+  { 6,  "4fab89a1a77b395f974a1b7ddcf6a34ef84f0e60cc2eb463569098d609f29836" },
+  { 77, "648ced66f3cf75d087f977c38dd55001eb193f07bdc24c1e2d7850ec9bcdd7d4" },
+  { 4,  "052c80cbf77e4221e21479bcde439de065b28a9a582d7cd64930741dce05e50d" },
+  { 24, "699350b97fd4735598c8975b008541ade6deec32baa340fcb1c623d32aa7cb1a" },
+  { 62, "434567bd2b0c3ae529dcf66c2de24253564a6819fe7c830c13c2eb6bb5f208be" },
+  { 3,  "4908a9a4f7bc4b2d2b25c4d182c5491aa36b374c576caa2bf4a3701367b0023d" },
+  { 74, "b2407fef79bb20508349cb64c0e5812c1d3f12a383fd0d5648e86f75200c03ad" },
+  { 32, "ee31dd559cc4e385871f00ecf51e192b6d536b037066e5c769999816ec9e614b" },
+};
+
+//no data at all
+static const char *pszEmptyHash = "6d5eea5394d05535374392486168c29e5edad18a0d231bde3335e044cd6af29f";
+
+static void CheckHeaderHashes(bool *pfOk)
+{
+  u8int header[80];
+  u32int seed = 12345;
+
+  *pfOk = true;
+  for(int i = 0; i < nHeaderHashes; i++)
+  {
+    FillHeader(header, seed);
+    if(dcrypt(header, sizeof(header)) != uint256(pszHeaderHashes[i]) ||
+       dcrypt_reference(header, sizeof(header)) != uint256(pszHeaderHashes[i]))
+      *pfOk = false;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(dcrypt_known_headers)
+{
+  //run twice so the second pass works on the reused scratch arena
+  for(int pass = 0; pass < 2; pass++)
+  {
+    bool fOk;
+    CheckHeaderHashes(&fOk);
+    BOOST_CHECK(fOk);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(dcrypt_known_lengths)
+{
+  u8int header[80];
+  u32int seed = 54321;
+
+  for(unsigned int i = 0; i < sizeof(lengthHashes) / sizeof(lengthHashes[0]); i++)
+  {
+    FillHeader(header, seed);
+    BOOST_CHECK_EQUAL(lengthHashes[i].nLen, (seed >> 8) % (sizeof(header) + 1));
+    BOOST_CHECK(dcrypt(header, lengthHashes[i].nLen) == uint256(lengthHashes[i].pszHash));
+    BOOST_CHECK(dcrypt_reference(header, lengthHashes[i].nLen) == uint256(lengthHashes[i].pszHash));
+  }
+
+  BOOST_CHECK(dcrypt(header, 0) == uint256(pszEmptyHash));
+  BOOST_CHECK(dcrypt_reference(header, 0) == uint256(pszEmptyHash));
+}
+
+BOOST_AUTO_TEST_CASE(dcrypt_thread_scratch)
+{
+  const int nThreads = 4;
+  bool fOk[nThreads];
+
+  boost::thread_group threads;
+  for(int i = 0; i < nThreads; i++)
+    threads.create_thread(boost::bind(&CheckHeaderHashes, &fOk[i]));
+  threads.join_all();
+
+  for(int i = 0; i < nThreads; i++)
+    BOOST_CHECK(fOk[i]);
+}
+
+//hashes nHeaders random headers with both dcrypt and dcrypt_reference and counts mismatches
+static void DiffHeaders(u32int seed, int nHeaders, int *pnMismatch)
+{
+  u8int header[80];
+
+  *pnMismatch = 0;
+  for(int i = 0; i < nHeaders; i++)
+  {
+    FillHeader(header, seed);
+
+    //mostly block headers, but also every length from empty up to a few sha256 blocks
+    size_t nLen = (i % 4) ? sizeof(header) : (seed >> 8) % (sizeof(header) + 1);
+    if(dcrypt(header, nLen) != dcrypt_reference(header, nLen))
+      (*pnMismatch)++;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(dcrypt_stream_matches_reference)
+{
+  //the default keeps the test suite fast, "make -f makefile.unix check-dcrypt" runs
+  // the full differential check over DCRYPT_DIFF_HEADERS=5000000 headers
+  int nHeaders = 5000;
+  if(getenv("DCRYPT_DIFF_HEADERS"))
+    nHeaders = atoi(getenv("DCRYPT_DIFF_HEADERS"));
+
+  int nThreads = std::max(1, (int)boost::thread::hardware_concurrency());
+  std::vector<int> vMismatch(nThreads, 0);
+
+  boost::thread_group threads;
+  for(int i = 0; i < nThreads; i++)
+    threads.create_thread(boost::bind(&DiffHeaders, 0x5eed0000 + i, nHeaders / nThreads + 1, &vMismatch[i]));
+  threads.join_all();
+
+  for(int i = 0; i < nThreads; i++)
+    BOOST_CHECK_EQUAL(vMismatch[i], 0);
+}
+
+BOOST_AUTO_TEST_CASE(sha256_lanes_match)
+{
+  static const u32int nLaneWidths[] = {1, 4, 8, 16};
+  const u32int nBlocks = 37;  //not a multiple of any lane width
+
+  u8int blocks[nBlocks][80], digest[DCRYPT_DIGEST_LENGTH];
+  const u8int *pblocks[nBlocks];
+  uint32_t states[nBlocks][8], refStates[nBlocks][8];
+  u32int seed = 777;
+
+  for(u32int i = 0; i < nBlocks; i++)
+  {
+    FillHeader(blocks[i], seed);
+    pblocks[i] = blocks[i];
+
+    memcpy(refStates[i], sha256_init_state, sizeof(refStates[i]));
+    sha256_transform(refStates[i], blocks[i]);
+  }
+
+  //the plain transform must agree with openssl
+  SHA256_CTX ctx;
+  SHA256_Init(&ctx);
+  SHA256_Update(&ctx, blocks[0], 64);
+  SHA256_Final(digest, &ctx);
+
+  uint32_t state[8];
+  memcpy(state, refStates[0], sizeof(state));
+  u8int pad[64] = {0x80};
+  pad[62] = 0x02;
+  sha256_transform(state, pad);
+  for(int i = 0; i < 8; i++)
+    BOOST_CHECK_EQUAL(state[i], (uint32_t)((digest[i * 4] << 24) | (digest[i * 4 + 1] << 16) |
+                                           (digest[i * 4 + 2] << 8) | digest[i * 4 + 3]));
+
+  for(u32int w = 0; w < sizeof(nLaneWidths) / sizeof(nLaneWidths[0]); w++)
+  {
+    sha256_lanes_init(nLaneWidths[w]);
+
+    for(u32int nLanes = 1; nLanes <= nBlocks; nLanes++)
+    {
+      for(u32int i = 0; i < nLanes; i++)
+        memcpy(states[i], sha256_init_state, sizeof(states[i]));
+
+      sha256_transform_lanes(states, pblocks, nLanes);
+      BOOST_CHECK(!memcmp(states, refStates, nLanes * sizeof(states[0])));
+    }
+  }
+
+  sha256_lanes_init();
+}
+
+BOOST_AUTO_TEST_CASE(dcrypt_multi_matches_dcrypt)
+{
+  static const u32int nLaneWidths[] = {1, 4, 8, 16};
+  const u32int nHeaders = 100;
+
+  u8int headers[nHeaders][80];
+  const u8int *pheaders[nHeaders];
+  uint256 hashes[nHeaders], refHashes[nHeaders];
+  u32int seed = 4242;
+
+  for(u32int i = 0; i < nHeaders; i++)
+  {
+    FillHeader(headers[i], seed);
+    pheaders[i] = headers[i];
+    refHashes[i] = dcrypt(headers[i], sizeof(headers[i]));
+  }
+
+  for(u32int w = 0; w < sizeof(nLaneWidths) / sizeof(nLaneWidths[0]); w++)
+  {
+    BOOST_TEST_MESSAGE(strprintf("dcrypt_multi with %u lanes", sha256_lanes_init(nLaneWidths[w])));
+
+    //a short batch leaves lanes idle, the full one keeps refilling retired lanes
+    dcrypt_multi(pheaders, sizeof(headers[0]), hashes, 3);
+    for(u32int i = 0; i < 3; i++)
+      BOOST_CHECK(hashes[i] == refHashes[i]);
+
+    dcrypt_multi(pheaders, sizeof(headers[0]), hashes, nHeaders);
+    for(u32int i = 0; i < nHeaders; i++)
+      BOOST_CHECK(hashes[i] == refHashes[i]);
+  }
+
+  sha256_lanes_init();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,233 @@
+#include <boost/test/unit_test.hpp>
+
+#include "kernel.h"
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+//before the v0.3 protocol, so the kernel hashes nBits and needs no stake modifier
+static const unsigned int nTimeStart = 1300000000;
+
+BOOST_AUTO_TEST_CASE(kernel_scan_matches_check)
+{
+  CBlockIndex indexFrom;
+  indexFrom.nTime = nTimeStart;
+
+  CTransaction txPrev;
+  txPrev.nTime = nTimeStart + 10;
+  txPrev.vout.resize(2);
+  txPrev.vout[1].nValue = 10 * COIN;
+  const COutPoint prevout(txPrev.GetHash(), 1);
+  const unsigned int nTxPrevOffset = 81;
+
+  //easy enough that some timestamps in the window pass
+  const unsigned int nBits = CBigNum(~uint256(0) >> 16).GetCompact();
+
+  CStakeCandidate candidate;
+  candidate.pindexFrom = &indexFrom;
+  candidate.nTimeBlockFrom = indexFrom.nTime;
+  candidate.nTxPrevOffset = nTxPrevOffset;
+  candidate.nTimeTxPrev = txPrev.nTime;
+  candidate.nPrevout = prevout.n;
+  candidate.nValueIn = txPrev.vout[1].nValue;
+  candidate.nStakeModifier = 0;
+  candidate.pindexModifierBest = NULL;
+
+  const unsigned int nTimeFirst = nTimeStart + 40 * 24 * 60 * 60;
+  int nPassed = 0;
+  for(unsigned int nTime = nTimeFirst; nTime < nTimeFirst + 2000; nTime++)
+  {
+    uint256 hashCheck, hashScan;
+    unsigned int nTimeScan;
+    const bool fCheck = CheckStakeKernelHash(nBits, &indexFrom, nTxPrevOffset, txPrev, prevout, nTime, hashCheck);
+    const bool fScan = ScanStakeKernelHash(nBits, candidate, nTime, 1, nTimeScan, hashScan);
+
+    BOOST_CHECK_EQUAL(fCheck, fScan);
+    BOOST_CHECK(hashCheck == hashScan);
+    if(fScan)
+    {
+      BOOST_CHECK_EQUAL(nTimeScan, nTime);
+      nPassed++;
+    }
+  }
+  BOOST_CHECK(nPassed > 0);
+
+  //a whole window finds the latest timestamp that passes
+  for(unsigned int nTime = nTimeFirst + 60; nTime < nTimeFirst + 2000; nTime += 60)
+  {
+    unsigned int nTimeScan;
+    uint256 hashScan, hashCheck;
+    if(!ScanStakeKernelHash(nBits, candidate, nTime, 60, nTimeScan, hashScan))
+      continue;
+
+    BOOST_CHECK(nTimeScan <= nTime && nTimeScan > nTime - 60);
+    BOOST_CHECK(CheckStakeKernelHash(nBits, &indexFrom, nTxPrevOffset, txPrev, prevout, nTimeScan, hashCheck));
+    for(unsigned int nLater = nTimeScan + 1; nLater <= nTime; nLater++)
+      BOOST_CHECK(!CheckStakeKernelHash(nBits, &indexFrom, nTxPrevOffset, txPrev, prevout, nLater, hashCheck));
+  }
+
+  //too young a coin never passes
+  unsigned int nTimeScan;
+  uint256 hashScan;
+  BOOST_CHECK(!ScanStakeKernelHash(nBits, candidate, nTimeStart + nStakeMinAge - 1, 60, nTimeScan, hashScan));
+}
+
+//a main chain with a block a day and a branch off its second block, every block
+// generating its own stake modifier
+static const unsigned int nTimeV03 = 1400000000;
+static CBlockIndex vModifierMain[30];
+static CBlockIndex vModifierBranch[30];
+
+static void LinkChain(CBlockIndex *vChain, CBlockIndex *pindexPrev, uint64 nModifierBase)
+{
+  for(int i = 0; i < 30; i++)
+  {
+    CBlockIndex &index = vChain[i];
+    index.pprev = i ? &vChain[i - 1] : pindexPrev;
+    index.pnext = i < 29 ? &vChain[i + 1] : NULL;
+    index.nHeight = index.pprev ? index.pprev->nHeight + 1 : 0;
+    index.nTime = nTimeV03 + index.nHeight * 24 * 60 * 60;
+    index.SetStakeModifier(nModifierBase + i, true);
+  }
+}
+
+//the kernel hash made with the modifier of one of the blocks in vChain, -1 if none
+static int FindKernelModifier(CBlockIndex *vChain, const uint256 &hashProofOfStake, const CTransaction &txPrev,
+                              unsigned int nTimeTx)
+{
+  for(int i = 0; i < 30; i++)
+  {
+    CDataStream ss(SER_GETHASH, 0);
+    ss << vChain[i].nStakeModifier << vModifierMain[1].nTime << (unsigned int)81 << txPrev.nTime
+       << (unsigned int)0 << nTimeTx;
+    if(Hash(ss.begin(), ss.end()) == hashProofOfStake)
+      return i;
+  }
+  return -1;
+}
+
+BOOST_AUTO_TEST_CASE(kernel_modifier_reorganize)
+{
+  CBlockIndex *pindexBestOld = pindexBest;
+
+  LinkChain(vModifierMain, NULL, 1);
+  LinkChain(vModifierBranch, &vModifierMain[1], 1000);
+  pindexBest = &vModifierMain[29];
+
+  CTransaction txPrev;
+  txPrev.nTime = vModifierMain[1].nTime + 10;
+  txPrev.vout.resize(1);
+  txPrev.vout[0].nValue = 10 * COIN;
+  const COutPoint prevout(txPrev.GetHash(), 0);
+  const unsigned int nTimeTx = vModifierMain[29].nTime;
+  const unsigned int nBits = CBigNum(~uint256(0) >> 16).GetCompact();
+
+  //walked on the main chain, then taken from the memo
+  int nMain = -1;
+  for(int i = 0; i < 2; i++)
+  {
+    uint256 hashProofOfStake = 0;
+    CheckStakeKernelHash(nBits, &vModifierMain[1], 81, txPrev, prevout, nTimeTx, hashProofOfStake);
+    int n = FindKernelModifier(vModifierMain, hashProofOfStake, txPrev, nTimeTx);
+    BOOST_CHECK(n > 1);
+    BOOST_CHECK(!i || n == nMain);
+    nMain = n;
+  }
+
+  //reorganize onto the branch, the block the memo ended on is off the main chain now
+  vModifierMain[1].pnext = &vModifierBranch[0];
+  for(int i = 2; i < 30; i++)
+    vModifierMain[i].pnext = NULL;
+  pindexBest = &vModifierBranch[29];
+
+  uint256 hashProofOfStake = 0;
+  CheckStakeKernelHash(nBits, &vModifierMain[1], 81, txPrev, prevout, nTimeTx, hashProofOfStake);
+  BOOST_CHECK_EQUAL(FindKernelModifier(vModifierMain, hashProofOfStake, txPrev, nTimeTx), -1);
+  BOOST_CHECK_EQUAL(FindKernelModifier(vModifierBranch, hashProofOfStake, txPrev, nTimeTx), nMain - 2);
+
+  //and back
+  LinkChain(vModifierMain, NULL, 1);
+  for(int i = 0; i < 30; i++)
+    vModifierBranch[i].pnext = NULL;
+  pindexBest = &vModifierMain[29];
+  CheckStakeKernelHash(nBits, &vModifierMain[1], 81, txPrev, prevout, nTimeTx, hashProofOfStake);
+  BOOST_CHECK_EQUAL(FindKernelModifier(vModifierMain, hashProofOfStake, txPrev, nTimeTx), nMain);
+
+  pindexBest = pindexBestOld;
+}
+
+//the v0.3 kernel every block on the chain stakes with, hashing the modifier
+// walked to from the block the coin was in
+BOOST_AUTO_TEST_CASE(kernel_scan_matches_check_v03)
+{
+  CBlockIndex *pindexBestOld = pindexBest;
+
+  LinkChain(vModifierMain, NULL, 1);
+  for(int i = 0; i < 30; i++)
+    vModifierBranch[i].pnext = NULL;
+  pindexBest = &vModifierMain[29];
+
+  CBlockIndex *pindexFrom = &vModifierMain[1];
+  CTransaction txPrev;
+  txPrev.nTime = pindexFrom->nTime + 10;
+  txPrev.vout.resize(1);
+  txPrev.vout[0].nValue = 10 * COIN;
+  const COutPoint prevout(txPrev.GetHash(), 0);
+  const unsigned int nTxPrevOffset = 81;
+  const unsigned int nBits = CBigNum(~uint256(0) >> 16).GetCompact();
+
+  CStakeCandidate candidate;
+  candidate.pindexFrom = pindexFrom;
+  candidate.nTimeBlockFrom = pindexFrom->nTime;
+  candidate.nTxPrevOffset = nTxPrevOffset;
+  candidate.nTimeTxPrev = txPrev.nTime;
+  candidate.nPrevout = prevout.n;
+  candidate.nValueIn = txPrev.vout[0].nValue;
+  candidate.nStakeModifier = 0;
+  candidate.pindexModifierBest = NULL;
+
+  const unsigned int nTimeFirst = pindexFrom->nTime + 40 * 24 * 60 * 60;
+  BOOST_CHECK(IsProtocolV03(nTimeFirst));
+
+  int nPassed = 0;
+  for(unsigned int nTime = nTimeFirst; nTime < nTimeFirst + 2000; nTime++)
+  {
+    uint256 hashCheck, hashScan;
+    unsigned int nTimeScan;
+    const bool fCheck = CheckStakeKernelHash(nBits, pindexFrom, nTxPrevOffset, txPrev, prevout, nTime, hashCheck);
+    const bool fScan = ScanStakeKernelHash(nBits, candidate, nTime, 1, nTimeScan, hashScan);
+
+    BOOST_CHECK_EQUAL(fCheck, fScan);
+    BOOST_CHECK(hashCheck == hashScan);
+    if(fScan)
+    {
+      BOOST_CHECK_EQUAL(nTimeScan, nTime);
+      nPassed++;
+    }
+  }
+  BOOST_CHECK(nPassed > 0);
+
+  //the hash is made with a modifier from later in the chain, not with nBits
+  uint256 hashScan;
+  unsigned int nTimeScan;
+  ScanStakeKernelHash(nBits, candidate, nTimeFirst, 1, nTimeScan, hashScan);
+  BOOST_CHECK(FindKernelModifier(vModifierMain, hashScan, txPrev, nTimeFirst) > 1);
+  BOOST_CHECK(candidate.pindexModifierBest == pindexBest);
+
+  //a whole window finds the latest timestamp that passes
+  for(unsigned int nTime = nTimeFirst + 60; nTime < nTimeFirst + 2000; nTime += 60)
+  {
+    uint256 hashCheck;
+    if(!ScanStakeKernelHash(nBits, candidate, nTime, 60, nTimeScan, hashScan))
+      continue;
+
+    BOOST_CHECK(nTimeScan <= nTime && nTimeScan > nTime - 60);
+    BOOST_CHECK(CheckStakeKernelHash(nBits, pindexFrom, nTxPrevOffset, txPrev, prevout, nTimeScan, hashCheck));
+    BOOST_CHECK(hashCheck == hashScan);
+    for(unsigned int nLater = nTimeScan + 1; nLater <= nTime; nLater++)
+      BOOST_CHECK(!CheckStakeKernelHash(nBits, pindexFrom, nTxPrevOffset, txPrev, prevout, nLater, hashCheck));
+  }
+
+  pindexBest = pindexBestOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,8 +1,12 @@
+#include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
 
 #include <string>
 #include <vector>
 
+#include <openssl/ecdsa.h>
+#include <openssl/obj_mac.h>
+
 #include "key.h"
 #include "base58.h"
 #include "uint256.h"
@@ -43,6 +47,53 @@ void dumpKeyInfo(uint256 privkey)
 }
 #endif
 
+// ECDSA_verify() on a key OpenSSL builds the curve for itself, what CKey::Verify() did
+// before keys shared one secp256k1 group
+static bool VerifyPlain(const vector<unsigned char> &vchPubKey, uint256 hash, const vector<unsigned char> &vchSig)
+{
+  EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+  const unsigned char* pbegin = &vchPubKey[0];
+  bool fValid = o2i_ECPublicKey(&pkey, &pbegin, vchPubKey.size()) &&
+                ECDSA_verify(0, (unsigned char*)&hash, sizeof(hash), &vchSig[0], vchSig.size(), pkey) == 1;
+  EC_KEY_free(pkey);
+  return fValid;
+}
+
+// the encoding OpenSSL gives back for a public key it parsed on its own curve, empty if
+// it can't parse it
+static vector<unsigned char> EncodePlain(const vector<unsigned char> &vchPubKey)
+{
+  vector<unsigned char> vchEncoded;
+  EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+  const unsigned char* pbegin = &vchPubKey[0];
+  if(o2i_ECPublicKey(&pkey, &pbegin, vchPubKey.size()))
+  {
+    vchEncoded.resize(i2o_ECPublicKey(pkey, NULL));
+    unsigned char* pout = &vchEncoded[0];
+    i2o_ECPublicKey(pkey, &pout);
+  }
+  EC_KEY_free(pkey);
+  return vchEncoded;
+}
+
+// checks one key reused for every public key, the way CheckSig() verifies, against
+// plain OpenSSL on every pair of public key and signature
+static void CheckVerifyPlain(CKey &key, const vector<vector<unsigned char> > &vvchPubKeys, uint256 hash,
+                             const vector<vector<unsigned char> > &vvchSigs)
+{
+  BOOST_FOREACH(const vector<unsigned char> &vchPubKey, vvchPubKeys)
+  {
+    const vector<unsigned char> vchEncoded = EncodePlain(vchPubKey);
+    BOOST_CHECK_EQUAL(key.SetPubKey(vchPubKey), !vchEncoded.empty());
+    if(vchEncoded.empty())
+      continue;
+    BOOST_CHECK(key.GetPubKey() == vchEncoded);
+
+    BOOST_FOREACH(const vector<unsigned char> &vchSig, vvchSigs)
+      BOOST_CHECK_EQUAL(key.Verify(hash, vchSig), VerifyPlain(vchPubKey, hash, vchSig));
+  }
+}
+
 
 BOOST_AUTO_TEST_SUITE(key_tests)
 
@@ -137,4 +188,122 @@ BOOST_AUTO_TEST_CASE(key_test1)
   }
 }
 
+BOOST_AUTO_TEST_CASE(key_verify_plain)
+{
+  CKey key;
+  for(int n=0; n<16; n++)
+  {
+    CKey keySign, keyOther;
+    keySign.MakeNewKey(n % 2 == 0);
+    keyOther.MakeNewKey(n % 2 == 1);
+
+    uint256 hashMsg = Hash(BEGIN(n), END(n));
+    vector<unsigned char> vchSig;
+    BOOST_CHECK(keySign.Sign(hashMsg, vchSig));
+
+    vector<unsigned char> vchBadSig(vchSig);
+    vchBadSig[vchBadSig.size() / 2] ^= 1;
+
+    vector<vector<unsigned char> > vvchPubKeys, vvchSigs;
+    vvchPubKeys.push_back(keySign.GetPubKey());
+    vvchPubKeys.push_back(keyOther.GetPubKey());
+    vvchSigs.push_back(vchSig);
+    vvchSigs.push_back(vchBadSig);
+    CheckVerifyPlain(key, vvchPubKeys, hashMsg, vvchSigs);
+    CheckVerifyPlain(key, vvchPubKeys, hashMsg + 1, vvchSigs);
+
+    BOOST_CHECK(key.SetPubKey(keySign.GetPubKey()));
+    BOOST_CHECK(key.Verify(hashMsg, vchSig));
+    BOOST_CHECK(key.SetPubKey(keyOther.GetPubKey()));
+    BOOST_CHECK(!key.Verify(hashMsg, vchSig));
+
+    // keys on the shared group still serialize with the named curve
+    CKey keyCopy;
+    BOOST_CHECK(keyCopy.SetPrivKey(keySign.GetPrivKey()));
+    BOOST_CHECK(keyCopy.GetPrivKey() == keySign.GetPrivKey());
+    BOOST_CHECK(keyCopy.Verify(hashMsg, vchSig));
+  }
+}
+
+// the fixed keys of key_test1, with their public keys in every encoding OpenSSL takes and
+// their signatures in non-canonical DER forms, checked against plain OpenSSL
+BOOST_AUTO_TEST_CASE(key_verify_vectors)
+{
+  CBitcoinSecret bsecret1, bsecret2;
+  BOOST_CHECK(bsecret1.SetString(strSecret1));
+  BOOST_CHECK(bsecret2.SetString(strSecret2));
+
+  bool fCompressed;
+  CKey keys[4];
+  keys[0].SetSecret(bsecret1.GetSecret(fCompressed), false);
+  keys[1].SetSecret(bsecret2.GetSecret(fCompressed), false);
+  keys[2].SetSecret(bsecret1.GetSecret(fCompressed), true);
+  keys[3].SetSecret(bsecret2.GetSecret(fCompressed), true);
+
+  vector<vector<unsigned char> > vvchPubKeys;
+  for(int i=0; i<4; i++)
+    vvchPubKeys.push_back(keys[i].GetPubKey());
+  for(int i=0; i<2; i++)
+  {
+    const vector<unsigned char> vchFull = keys[i].GetPubKey();
+
+    // hybrid, with the right and the wrong parity of y
+    vector<unsigned char> vchHybrid(vchFull);
+    vchHybrid[0] = 0x06 | (vchFull.back() & 1);
+    vvchPubKeys.push_back(vchHybrid);
+    vchHybrid[0] ^= 1;
+    vvchPubKeys.push_back(vchHybrid);
+
+    // off the curve, a bad prefix and a truncated key
+    vector<unsigned char> vchBad(vchFull);
+    vchBad.back() ^= 1;
+    vvchPubKeys.push_back(vchBad);
+    vchBad = vchFull;
+    vchBad[0] = 0x05;
+    vvchPubKeys.push_back(vchBad);
+    vvchPubKeys.push_back(vector<unsigned char>(vchFull.begin(), vchFull.end() - 1));
+  }
+
+  CKey key;
+  for(int n=0; n<16; n++)
+  {
+    string strMsg = strprintf("Very secret message %i: 11", n);
+    uint256 hashMsg = Hash(strMsg.begin(), strMsg.end());
+
+    vector<vector<unsigned char> > vvchSigs;
+    for(int i=0; i<4; i++)
+    {
+      vector<unsigned char> vchSig;
+      BOOST_CHECK(keys[i].Sign(hashMsg, vchSig));
+      vvchSigs.push_back(vchSig);
+
+      // 30 len 02 lenR R 02 lenS S
+      const unsigned int nLenR = vchSig[3];
+
+      // r with a needless leading zero
+      vector<unsigned char> vchPadded(vchSig);
+      vchPadded.insert(vchPadded.begin() + 4, 0x00);
+      vchPadded[3]++;
+      vchPadded[1]++;
+      vvchSigs.push_back(vchPadded);
+
+      // the sequence length in long form
+      vector<unsigned char> vchLong(vchSig);
+      vchLong.insert(vchLong.begin() + 1, 0x81);
+      vvchSigs.push_back(vchLong);
+
+      // trailing garbage, a truncated signature and a flipped bit in s
+      vector<unsigned char> vchBad(vchSig);
+      vchBad.push_back(0x01);
+      vvchSigs.push_back(vchBad);
+      vvchSigs.push_back(vector<unsigned char>(vchSig.begin(), vchSig.end() - 1));
+      vchBad = vchSig;
+      vchBad[4 + nLenR + 2] ^= 1;
+      vvchSigs.push_back(vchBad);
+    }
+
+    CheckVerifyPlain(key, vvchPubKeys, hashMsg, vvchSigs);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
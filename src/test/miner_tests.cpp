@@ -3,6 +3,7 @@
 #include "uint256.h"
 #include "util.h"
 #include "dcrypt.h"
+#include "main.h"
 
 extern void SHA256Transform(void* pstate, void* pinput, const void* pinit);
 
@@ -43,4 +44,43 @@ BOOST_AUTO_TEST_CASE(dcryptHash)
   
 }
 
+BOOST_AUTO_TEST_CASE(block_hash_cache)
+{
+  //the mainnet genesis header
+  CBlock block;
+  block.nVersion       = 1;
+  block.hashPrevBlock  = 0;
+  block.hashMerkleRoot = uint256("0x0b0d42f6519b7d19f4ac4ad5fefddfdd1499add41a0ce0933f3d8a01cd79726e");
+  block.nTime          = 1418270653;
+  block.nBits          = 0x1e0fffff;
+  block.nNonce         = 908764;
+
+  BOOST_CHECK(block.GetHash() == hashGenesisBlockOfficial);
+  BOOST_CHECK(block.GetHash() == hashGenesisBlockOfficial);
+
+  //any header change has to show up in the hash
+  block.nNonce++;
+  uint256 hashNonce = dcrypt(UBEGIN(block.nVersion), HASH_BLOCK_SIZE(block));
+  BOOST_CHECK(block.GetHash() == hashNonce);
+  BOOST_CHECK(hashNonce != hashGenesisBlockOfficial);
+
+  block.hashMerkleRoot = 0;
+  BOOST_CHECK(block.GetHash() == dcrypt(UBEGIN(block.nVersion), HASH_BLOCK_SIZE(block)));
+
+  //copies carry the cached hash but still notice their own changes
+  CBlock blockCopy = block;
+  BOOST_CHECK(blockCopy.GetHash() == block.GetHash());
+  blockCopy.nTime++;
+  BOOST_CHECK(blockCopy.GetHash() != block.GetHash());
+
+  //as does a header read over the top of it
+  CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+  ss << block;
+  ss >> blockCopy;
+  BOOST_CHECK(blockCopy.GetHash() == block.GetHash());
+
+  block.SetNull();
+  BOOST_CHECK(block.GetHash() == dcrypt(UBEGIN(block.nVersion), HASH_BLOCK_SIZE(block)));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -241,6 +241,140 @@ BOOST_AUTO_TEST_CASE(switchover)
     BOOST_CHECK(!Verify(scriptSig, fund, true));
 }
 
+BOOST_AUTO_TEST_CASE(scriptcheck)
+{
+    // Test CScriptCheck, the deferred form of VerifySignature() ConnectBlock() uses
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    CScript notValid;
+    notValid << OP_11 << OP_12 << OP_EQUALVERIFY;
+
+    CTransaction txFrom;
+    txFrom.vout.resize(2);
+    txFrom.vout[0].scriptPubKey.SetBitcoinAddress(key.GetPubKey());
+    txFrom.vout[1].scriptPubKey.SetPayToScriptHash(notValid);
+
+    CTransaction txTo;
+    txTo.vin.resize(2);
+    txTo.vout.resize(1);
+    for(int i = 0; i < 2; i++)
+    {
+        txTo.vin[i].prevout.n = i;
+        txTo.vin[i].prevout.hash = txFrom.GetHash();
+    }
+    txTo.vout[0].nValue = 1;
+    txTo.vin[1].scriptSig << Serialize(notValid);
+    BOOST_CHECK(SignSignature(keystore, txFrom, txTo, 0));
+
+    for(unsigned int i = 0; i < 2; i++)
+    {
+        CScriptCheck check(txFrom.vout[i], txTo, i, true);
+        BOOST_CHECK_EQUAL(check.Verify(), VerifySignature(txFrom, txTo, i, true, 0));
+        BOOST_CHECK_EQUAL(check.Verify(false), VerifySignature(txFrom, txTo, i, false, 0));
+    }
+
+    // The p2sh input only passes under the old rules
+    BOOST_CHECK(CScriptCheck(txFrom.vout[0], txTo, 0, true).Verify());
+    BOOST_CHECK(!CScriptCheck(txFrom.vout[1], txTo, 1, true).Verify());
+    BOOST_CHECK(CScriptCheck(txFrom.vout[1], txTo, 1, false).Verify());
+
+    // Checked against the wrong output it fails
+    BOOST_CHECK(!CScriptCheck(txFrom.vout[1], txTo, 0, true).Verify());
+}
+
+BOOST_AUTO_TEST_CASE(scriptcheck_ranges)
+{
+    // A block's worth of inputs checked on the script check threads the way
+    // ConnectBlock() queues them, a few inputs a transaction at a time
+    mapArgs["-scriptcheckthreads"] = "3";
+    StartScriptCheckThreads();
+
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    const unsigned int nInputs = 100, nBad = 37;
+    CTransaction txFrom;
+    txFrom.vout.resize(nInputs);
+    BOOST_FOREACH(CTxOut &txout, txFrom.vout)
+        txout.scriptPubKey.SetBitcoinAddress(key.GetPubKey());
+
+    CTransaction txTo;
+    txTo.vin.resize(nInputs);
+    txTo.vout.resize(1);
+    txTo.vout[0].nValue = 1;
+    for(unsigned int i = 0; i < nInputs; i++)
+    {
+        txTo.vin[i].prevout.n = i;
+        txTo.vin[i].prevout.hash = txFrom.GetHash();
+    }
+    for(unsigned int i = 0; i < nInputs; i++)
+        BOOST_CHECK(SignSignature(keystore, txFrom, txTo, i));
+    const CScript scriptSigGood = txTo.vin[nBad].scriptSig;
+
+    // exactly one input carries a signature made for another input
+    txTo.vin[nBad].scriptSig = txTo.vin[nBad + 1].scriptSig;
+
+    for(int nPass = 0; nPass < 2; nPass++)
+    {
+        CScriptCheckRanges ranges;
+        for(unsigned int i = 0; i < nInputs; i += 3)
+        {
+            vector<CScriptCheck> vChecks;
+            for(unsigned int j = i; j < min(i + 3, nInputs); j++)
+                vChecks.push_back(CScriptCheck(txFrom.vout[j], txTo, j, true));
+            ranges.Add(vChecks);
+            BOOST_CHECK(vChecks.empty());
+        }
+
+        const CScriptCheckRange *prangeFailed = ranges.Wait();
+        BOOST_CHECK_EQUAL(prangeFailed != NULL, nPass == 0);
+        if(prangeFailed)
+        {
+            BOOST_CHECK(prangeFailed->pcheckFailed != NULL);
+            BOOST_CHECK_EQUAL(prangeFailed->pcheckFailed->nIn, nBad);
+            BOOST_CHECK(!prangeFailed->fP2SHFailure);
+        }
+
+        // every range ran before Wait() returned, the failed one up to its bad check
+        unsigned int nChecks = 0;
+        BOOST_FOREACH(const CScriptCheckRange &range, ranges.GetRanges())
+        {
+            if(&range != &ranges.GetRanges().back())
+                BOOST_CHECK(range.vChecks.size() >= SCRIPT_CHECK_CHUNK);
+            if(&range == prangeFailed)
+                BOOST_CHECK_EQUAL(range.nChecked, (unsigned int)(range.pcheckFailed - &range.vChecks[0]) + 1);
+            else
+            {
+                BOOST_CHECK(range.pcheckFailed == NULL);
+                BOOST_CHECK_EQUAL(range.nChecked, (unsigned int)range.vChecks.size());
+            }
+            nChecks += range.vChecks.size();
+        }
+        BOOST_CHECK_EQUAL(nChecks, nInputs);
+
+        txTo.vin[nBad].scriptSig = scriptSigGood;
+    }
+
+    // ranges still queued when the block gives up early are waited on, not left
+    // running on a transaction that is about to go away
+    {
+        CScriptCheckRanges ranges;
+        for(unsigned int i = 0; i < nInputs; i++)
+        {
+            vector<CScriptCheck> vChecks(1, CScriptCheck(txFrom.vout[i], txTo, i, true));
+            ranges.Add(vChecks);
+        }
+    }
+
+    StopScriptCheckThreads();
+    mapArgs.erase("-scriptcheckthreads");
+}
+
 BOOST_AUTO_TEST_CASE(AreInputsStandard)
 {
     std::map<uint256, std::pair<CTxIndex, CTransaction> > mapInputs;
@@ -22,6 +22,9 @@ using namespace boost::algorithm;
 extern uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
 extern bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
                          bool fValidatePayToScriptHash, int nHashType);
+extern bool IsSignatureCached(const uint256 &sighash, const std::vector<unsigned char> &vchSig,
+                              const std::vector<unsigned char> &vchPubKey);
+extern uint64 GetSignatureCacheHits();
 
 CScript
 ParseScript(string s)
@@ -323,5 +326,99 @@ BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG23)
     BOOST_CHECK(!VerifyScript(badsig6, scriptPubKey23, txTo23, 0, true, 0));
 }    
 
+BOOST_AUTO_TEST_CASE(script_sigcache)
+{
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(false);
+
+    CScript scriptPubKey12;
+    scriptPubKey12 << OP_1 << key1.GetPubKey() << key2.GetPubKey() << OP_2 << OP_CHECKMULTISIG;
+
+    CTransaction txTo12;
+    txTo12.vin.resize(1);
+    txTo12.vout.resize(1);
+    txTo12.vin[0].prevout.n = 0;
+    txTo12.vout[0].nValue = 1;
+
+    // Checked again, as a block does after the memory pool, a signature comes out the same
+    CScript goodsig2 = sign_multisig(scriptPubKey12, key2, txTo12);
+    for(int i = 0; i < 2; i++)
+        BOOST_CHECK(VerifyScript(goodsig2, scriptPubKey12, txTo12, 0, true, 0));
+
+    // A cached signature does not pass for another transaction or under another key
+    txTo12.vout[0].nValue = 2;
+    BOOST_CHECK(!VerifyScript(goodsig2, scriptPubKey12, txTo12, 0, true, 0));
+    txTo12.vout[0].nValue = 1;
+
+    CScript scriptPubKey1;
+    scriptPubKey1 << OP_1 << key1.GetPubKey() << OP_1 << OP_CHECKMULTISIG;
+    BOOST_CHECK(!VerifyScript(goodsig2, scriptPubKey1, txTo12, 0, true, 0));
+
+    // Nor does anything past a full cache
+    mapArgs["-maxsigcachesize"] = "1";
+    CScript goodsig1 = sign_multisig(scriptPubKey12, key1, txTo12);
+    for(int i = 0; i < 2; i++)
+    {
+        BOOST_CHECK(VerifyScript(goodsig1, scriptPubKey12, txTo12, 0, true, 0));
+        BOOST_CHECK(VerifyScript(goodsig2, scriptPubKey12, txTo12, 0, true, 0));
+    }
+    txTo12.vout[0].nValue = 2;
+    BOOST_CHECK(!VerifyScript(goodsig1, scriptPubKey12, txTo12, 0, true, 0));
+    mapArgs.erase("-maxsigcachesize");
+}
+
+BOOST_AUTO_TEST_CASE(script_sigcache_hits)
+{
+    CKey key1, key2;
+    key1.MakeNewKey(false);
+    key2.MakeNewKey(false);
+    bool fCompressed;
+    CKey key1C;
+    key1C.SetSecret(key1.GetSecret(fCompressed), true);
+
+    CScript scriptPubKey1, scriptPubKey1C, scriptPubKey2;
+    scriptPubKey1 << key1.GetPubKey() << OP_CHECKSIG;
+    scriptPubKey1C << key1C.GetPubKey() << OP_CHECKSIG;
+    scriptPubKey2 << key2.GetPubKey() << OP_CHECKSIG;
+
+    CTransaction txTo;
+    txTo.vin.resize(1);
+    txTo.vout.resize(1);
+    txTo.vin[0].prevout.n = 0;
+    txTo.vout[0].nValue = 1;
+
+    uint256 hash = SignatureHash(scriptPubKey1, txTo, 0, SIGHASH_ALL);
+    vector<unsigned char> vchSig;
+    BOOST_CHECK(key1.Sign(hash, vchSig));
+    CScript scriptSig;
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    scriptSig << vchSig;
+    vchSig.pop_back();
+
+    // The first check verifies and caches the signature, the second one hits
+    uint64 nHits = GetSignatureCacheHits();
+    BOOST_CHECK(!IsSignatureCached(hash, vchSig, key1.GetPubKey()));
+    BOOST_CHECK(VerifyScript(scriptSig, scriptPubKey1, txTo, 0, true, 0));
+    BOOST_CHECK_EQUAL(GetSignatureCacheHits(), nHits);
+    BOOST_CHECK(IsSignatureCached(hash, vchSig, key1.GetPubKey()));
+    BOOST_CHECK(VerifyScript(scriptSig, scriptPubKey1, txTo, 0, true, 0));
+    BOOST_CHECK_EQUAL(GetSignatureCacheHits(), nHits + 1);
+
+    // The same signature misses under another key, under another encoding of the
+    // same key and for another signature hash
+    BOOST_CHECK(!IsSignatureCached(hash, vchSig, key2.GetPubKey()));
+    BOOST_CHECK(!VerifyScript(scriptSig, scriptPubKey2, txTo, 0, true, 0));
+    BOOST_CHECK(!IsSignatureCached(hash, vchSig, key1C.GetPubKey()));
+    BOOST_CHECK(!VerifyScript(scriptSig, scriptPubKey1C, txTo, 0, true, 0));
+    BOOST_CHECK_EQUAL(GetSignatureCacheHits(), nHits + 1);
+
+    txTo.vout[0].nValue = 2;
+    uint256 hashOther = SignatureHash(scriptPubKey1, txTo, 0, SIGHASH_ALL);
+    BOOST_CHECK(!IsSignatureCached(hashOther, vchSig, key1.GetPubKey()));
+    BOOST_CHECK(!VerifyScript(scriptSig, scriptPubKey1, txTo, 0, true, 0));
+    BOOST_CHECK_EQUAL(GetSignatureCacheHits(), nHits + 1);
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -124,4 +124,57 @@ BOOST_AUTO_TEST_CASE(test_GetThrow)
   BOOST_CHECK_THROW(t1.GetValueIn(missingInputs), runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(test_HashCache)
+{
+  CTransaction t1;
+  t1.vin.resize(1);
+  t1.vin[0].prevout.hash = GetRandHash();
+  t1.vin[0].prevout.n = 0;
+  t1.vout.resize(1);
+  t1.vout[0].nValue = 90*CENT;
+  t1.vout[0].scriptPubKey << OP_1;
+
+  //a built transaction is rehashed, changes show up without any invalidation
+  uint256 hashBuilt = t1.GetHash();
+  t1.vout[0].nValue = 80*CENT;
+  BOOST_CHECK(t1.GetHash() != hashBuilt);
+  BOOST_CHECK(t1.GetHash() == SerializeHash(t1));
+
+  //one read from a stream, and copies of it, keep their hash
+  CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+  ss << t1;
+  CTransaction t2;
+  ss >> t2;
+  BOOST_CHECK(t2.GetHash() == t1.GetHash());
+  BOOST_CHECK(t2.fHashCached);
+
+  CTransaction t3(t2);
+  BOOST_CHECK(t3.fHashCached && t3.GetHash() == t1.GetHash());
+
+  //until it is invalidated before a change
+  t3.InvalidateHash();
+  t3.vin[0].scriptSig << OP_2;
+  BOOST_CHECK(t3.GetHash() == SerializeHash(t3));
+  BOOST_CHECK(t3.GetHash() != t2.GetHash());
+  t3.vin[0].scriptSig << OP_3;
+  BOOST_CHECK(t3.GetHash() == SerializeHash(t3));
+
+  //reading over the top of a transaction drops what it had cached
+  ss << t3;
+  ss >> t2;
+  BOOST_CHECK(t2.GetHash() == t3.GetHash());
+
+  //a read that fails part way keeps neither the old hash nor caches the new one
+  BOOST_CHECK(t2.fHashCached);
+  CDataStream ssShort(SER_NETWORK, PROTOCOL_VERSION);
+  ssShort << t1;
+  ssShort.resize(ssShort.size() - 1);
+  BOOST_CHECK_THROW(ssShort >> t2, std::ios_base::failure);
+  BOOST_CHECK(!t2.fHashCached && !t2.fHashCacheable);
+  BOOST_CHECK(t2.GetHash() == SerializeHash(t2));
+
+  t2.SetNull();
+  BOOST_CHECK(t2.GetHash() == SerializeHash(t2));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
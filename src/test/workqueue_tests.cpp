@@ -0,0 +1,86 @@
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include "util.h"
+#include "workqueue.h"
+
+BOOST_AUTO_TEST_SUITE(workqueue_tests)
+
+//enough work per item that the threads get to overlap
+static uint256 HashChain(int n)
+{
+  uint256 hash = n;
+  for(int i = 0; i < 1000; i++)
+    hash = Hash(BEGIN(hash), END(hash));
+  return hash;
+}
+
+class CHashChain : public CWorkItem
+{
+public:
+  int n;
+  uint256 hashResult;
+
+  CHashChain(int nIn) : n(nIn) {}
+
+  void Run()
+  {
+    hashResult = HashChain(n);
+  }
+};
+
+class CThrow : public CWorkItem
+{
+public:
+  void Run()
+  {
+    throw std::runtime_error("CThrow");
+  }
+};
+
+static void RunHashChains(CWorkQueue &queue)
+{
+  std::vector<CHashChain*> vItems;
+  for(int i = 0; i < 200; i++)
+  {
+    vItems.push_back(new CHashChain(i));
+    queue.Push(vItems.back());
+  }
+
+  //waited on in order, whatever order they ran in
+  for(int i = 0; i < 200; i++)
+  {
+    queue.Wait(vItems[i]);
+    BOOST_CHECK(vItems[i]->hashResult == HashChain(i));
+    delete vItems[i];
+  }
+}
+
+BOOST_AUTO_TEST_CASE(workqueue_no_threads)
+{
+  //everything runs inside Wait()
+  CWorkQueue queue("workqueue_no_threads");
+  BOOST_CHECK(queue.GetThreads() == 0);
+  RunHashChains(queue);
+}
+
+BOOST_AUTO_TEST_CASE(workqueue_threads)
+{
+  CWorkQueue queue("workqueue_threads");
+  BOOST_CHECK(queue.Start(4) == 4);
+  RunHashChains(queue);
+
+  //a throwing item still counts as done
+  CThrow item;
+  queue.Push(&item);
+  queue.Wait(&item);
+
+  queue.Stop();
+  BOOST_CHECK(queue.GetThreads() == 0);
+
+  //stopped queues run items inline
+  RunHashChains(queue);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
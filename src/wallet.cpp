@@ -1242,6 +1242,51 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, int64 nValue, CWalletTx& w
 }
 
 // heat: create coin stake transaction
+// Brings mapStakeCandidates in line with the coins selected for staking, only coins that
+// are new to it or confirmed in another block since have their transaction index read
+void CWallet::UpdateStakeCandidates(const set<pair<const CWalletTx*,unsigned int> > &setCoins)
+{
+  map<COutPoint, CStakeCandidate> mapNew;
+  vector<pair<const CWalletTx*,unsigned int> > vMissing;
+
+  BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
+  {
+    map<uint256, CBlockIndex*>::iterator miIndex = mapBlockIndex.find(pcoin.first->hashBlock);
+    if(miIndex == mapBlockIndex.end()) //sanity check
+      continue;
+
+    COutPoint prevout(pcoin.first->GetHash(), pcoin.second);
+    map<COutPoint, CStakeCandidate>::iterator mi = mapStakeCandidates.find(prevout);
+    if(mi != mapStakeCandidates.end() && mi->second.pindexFrom == miIndex->second)
+      mapNew[prevout] = mi->second;
+    else
+      vMissing.push_back(pcoin);
+  }
+
+  if(!vMissing.empty())
+  {
+    CTxDB txdb("r");
+    BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, vMissing)
+    {
+      CTxIndex txindex;
+      if(!txdb.ReadTxIndex(pcoin.first->GetHash(), txindex))
+        continue;
+
+      CStakeCandidate &candidate = mapNew[COutPoint(pcoin.first->GetHash(), pcoin.second)];
+      candidate.pindexFrom = mapBlockIndex[pcoin.first->hashBlock];
+      candidate.nTimeBlockFrom = candidate.pindexFrom->GetBlockTime();
+      candidate.nTxPrevOffset = txindex.pos.nTxPos - txindex.pos.nBlockPos;
+      candidate.nTimeTxPrev = pcoin.first->nTime;
+      candidate.nPrevout = pcoin.second;
+      candidate.nValueIn = pcoin.first->vout[pcoin.second].nValue;
+      candidate.nStakeModifier = 0;
+      candidate.pindexModifierBest = NULL;
+    }
+  }
+
+  mapStakeCandidates.swap(mapNew);
+}
+
 bool CWallet::CreateCoinStake(const CKeyStore &keystore, unsigned int nBits, 
                               int64 nSearchInterval, CTransaction &txNew)
 {
@@ -1282,91 +1327,88 @@ bool CWallet::CreateCoinStake(const CKeyStore &keystore, unsigned int nBits,
 
   int64 nCredit = 0;
   CScript scriptPubKeyKernel;
+  UpdateStakeCandidates(setCoins);
   BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
   {
-    CTxDB txdb("r");
-    CTxIndex txindex;
-    if(!txdb.ReadTxIndex(pcoin.first->GetHash(), txindex))
+    COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+    map<COutPoint, CStakeCandidate>::iterator mi = mapStakeCandidates.find(prevoutStake);
+    if(mi == mapStakeCandidates.end())
       continue;
-
-    // Read block index
-    if(!mapBlockIndex.count(pcoin.first->hashBlock)) //sanity check
-      continue;
-    CBlockIndex *pindex = mapBlockIndex[pcoin.first->hashBlock];
+    CStakeCandidate &candidate = mi->second;
+    const CBlockIndex *pindex = candidate.pindexFrom;
 
     static int nMaxStakeSearchInterval = 60;
     if(pindex->GetBlockTime() + nStakeMinAge > txNew.nTime - nMaxStakeSearchInterval)
       continue; // only count coins meeting min age requirement
 
     bool fKernelFound = false;
-    for(unsigned int n = 0; n < min(nSearchInterval, (int64)nMaxStakeSearchInterval) && 
-          !fKernelFound && !fShutdown; n++)
+    // Search backward in time from the given txNew timestamp 
+    // Search nSearchInterval seconds back up to nMaxStakeSearchInterval,
+    // a kernel found in memory is checked again the way a block's is
+    unsigned int nTimeKernel;
+    uint256 hashProofOfStake = 0;
+    if(ScanStakeKernelHash(nBits, candidate, txNew.nTime, min(nSearchInterval, (int64)nMaxStakeSearchInterval),
+                           nTimeKernel, hashProofOfStake) &&
+       CheckStakeKernelHash(nBits, pindex, candidate.nTxPrevOffset, *pcoin.first, prevoutStake,
+                            nTimeKernel, hashProofOfStake))
     {
-      // Search backward in time from the given txNew timestamp 
-      // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-      uint256 hashProofOfStake = 0;
-      COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-      if(CheckStakeKernelHash(nBits, pindex, txindex.pos.nTxPos - txindex.pos.nBlockPos,
-                              *pcoin.first, prevoutStake, txNew.nTime - n, hashProofOfStake))
-      {
-        bool fPrintCoinStake = (fDebug && GetBoolArg("-printcoinstake"));
+      const unsigned int n = txNew.nTime - nTimeKernel;
+      bool fPrintCoinStake = (fDebug && GetBoolArg("-printcoinstake"));
 
-        // Found a kernel
-        if(fPrintCoinStake)
-          printf("CreateCoinStake : kernel found\n");
+      // Found a kernel
+      if(fPrintCoinStake)
+        printf("CreateCoinStake : kernel found\n");
 
-        vector<valtype> vSolutions;
-        txnouttype whichType;
-        CScript scriptPubKeyOut;
-        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+      vector<valtype> vSolutions;
+      txnouttype whichType;
+      CScript scriptPubKeyOut;
+      scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
 
-        if(!Solver(scriptPubKeyKernel, whichType, vSolutions))
-        {
-          if(fPrintCoinStake)
-            printf("CreateCoinStake : failed to parse kernel\n", whichType);
-          break;
-        }
+      if(!Solver(scriptPubKeyKernel, whichType, vSolutions))
+      {
+        if(fPrintCoinStake)
+          printf("CreateCoinStake : failed to parse kernel\n", whichType);
+        continue;
+      }
+
+      if(fPrintCoinStake)
+        printf("CreateCoinStake : parsed kernel type=%d\n", whichType);
 
+      if(whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
+      {
         if(fPrintCoinStake)
-          printf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+          printf("CreateCoinStake : no support for kernel type=%d\n", whichType);
 
-        if(whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
+        continue;  // only support pay to public key and pay to address
+      }
+
+      if(whichType == TX_PUBKEYHASH) // pay to address type
+      {
+        // convert to pay to public key type
+        CKey key;
+        if(!keystore.GetKey(uint160(vSolutions[0]), key))
         {
           if(fPrintCoinStake)
-            printf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-
-          break;  // only support pay to public key and pay to address
+            printf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+          continue;  // unable to find corresponding public key
         }
+        scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+      }else
+        scriptPubKeyOut = scriptPubKeyKernel;
 
-        if(whichType == TX_PUBKEYHASH) // pay to address type
-        {
-          // convert to pay to public key type
-          CKey key;
-          if(!keystore.GetKey(uint160(vSolutions[0]), key))
-          {
-            if(fPrintCoinStake)
-              printf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-            break;  // unable to find corresponding public key
-          }
-          scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-        }else
-          scriptPubKeyOut = scriptPubKeyKernel;
-
-        txNew.nTime -= n; 
-        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-        nCredit += pcoin.first->vout[pcoin.second].nValue;
-        vwtxPrev.push_back(pcoin.first);
-        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+      txNew.nTime -= n; 
+      txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+      nCredit += pcoin.first->vout[pcoin.second].nValue;
+      vwtxPrev.push_back(pcoin.first);
+      txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-        if(pindex->GetBlockTime() + nStakeSplitAge > txNew.nTime)
-          txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+      if(pindex->GetBlockTime() + nStakeSplitAge > txNew.nTime)
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
 
-        if(fPrintCoinStake)
-          printf("CreateCoinStake : added kernel type=%d\n", whichType);
+      if(fPrintCoinStake)
+        printf("CreateCoinStake : added kernel type=%d\n", whichType);
 
-        fKernelFound = true;
-        break;
-      }
+      fKernelFound = true;
     }
 
     if(fKernelFound || fShutdown)
@@ -57,6 +57,23 @@ public:
       )
     };
 
+/** What the stake kernel hash of a wallet output needs besides the timestamp,
+ * kept so searching for a kernel needs no disk access, see ScanStakeKernelHash()
+ */
+struct CStakeCandidate
+{
+  const CBlockIndex *pindexFrom;
+  unsigned int nTimeBlockFrom;
+  unsigned int nTxPrevOffset;
+  unsigned int nTimeTxPrev;
+  unsigned int nPrevout;
+  int64 nValueIn;
+
+  // the v0.3 stake modifier, resolved while pindexModifierBest was the best block
+  uint64 nStakeModifier;
+  const CBlockIndex *pindexModifierBest;
+};
+
 /** A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
@@ -66,6 +83,10 @@ private:
   bool SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
   bool SelectCoins(int64 nTargetValue, unsigned int nSpendTime, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
 
+  // the coins last selected for staking, guarded by cs_wallet
+  std::map<COutPoint, CStakeCandidate> mapStakeCandidates;
+  void UpdateStakeCandidates(const std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins);
+
   CWalletDB *pwalletdbEncryption;
 
   // the current wallet version: clients below this version are not able to load the wallet
@@ -0,0 +1,98 @@
+// Copyright (c) 2013-2014 The heat developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "workqueue.h"
+#include "util.h"
+
+void CWorkQueue::RunFront(boost::unique_lock<boost::mutex> &lock)
+{
+  CWorkItem *pitem = queue.front();
+  queue.pop_front();
+
+  lock.unlock();
+  try
+  {
+    pitem->Run();
+  }
+  catch (std::exception& e) {
+    PrintExceptionContinue(&e, pszName);
+  } catch (...) {
+    PrintExceptionContinue(NULL, pszName);
+  }
+  lock.lock();
+
+  pitem->fDone = true;
+  condDone.notify_all();
+}
+
+void CWorkQueue::ThreadWorker(void *parg)
+{
+  CWorkQueue *pqueue = (CWorkQueue*)parg;
+  boost::unique_lock<boost::mutex> lock(pqueue->mutex);
+
+  for(;;)
+  {
+    while(pqueue->queue.empty() && !pqueue->fStop)
+      pqueue->condWork.wait(lock);
+
+    if(pqueue->fStop)
+      break;
+
+    pqueue->RunFront(lock);
+  }
+
+  pqueue->nThreadsRunning--;
+  pqueue->condDone.notify_all();
+}
+
+int CWorkQueue::Start(int nThreadsIn)
+{
+  boost::unique_lock<boost::mutex> lock(mutex);
+  fStop = false;
+
+  for(; nThreads < nThreadsIn; nThreads++)
+  {
+    if(!CreateThread(ThreadWorker, this))
+    {
+      printf("Error: CreateThread(%s) failed\n", pszName);
+      break;
+    }
+    nThreadsRunning++;
+  }
+
+  return nThreads;
+}
+
+void CWorkQueue::Stop()
+{
+  boost::unique_lock<boost::mutex> lock(mutex);
+  fStop = true;
+  condWork.notify_all();
+
+  while(nThreadsRunning > 0)
+    condDone.wait(lock);
+
+  nThreads = 0;
+}
+
+void CWorkQueue::Push(CWorkItem *pitem)
+{
+  boost::unique_lock<boost::mutex> lock(mutex);
+  pitem->fDone = false;
+  queue.push_back(pitem);
+  condWork.notify_one();
+}
+
+void CWorkQueue::Wait(CWorkItem *pitem)
+{
+  boost::unique_lock<boost::mutex> lock(mutex);
+
+  while(!pitem->fDone)
+  {
+    if(!queue.empty())
+      RunFront(lock);
+    else
+      condDone.wait(lock);
+  }
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2013-2014 The heat developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <deque>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/** One piece of work for a CWorkQueue, Run() may be called on any thread */
+class CWorkItem
+{
+public:
+  CWorkItem() : fDone(false) {}
+  virtual ~CWorkItem() {}
+
+  virtual void Run() = 0;
+
+private:
+  bool fDone; //guarded by the queue's mutex
+  friend class CWorkQueue;
+};
+
+/** A pool of threads running CWorkItems in the order they were pushed.
+ *  Items finish in any order, whoever pushed them decides the order the
+ *  results are used in by the order it Wait()s on them. A thread waiting
+ *  on an item runs queued items itself, so with no threads started every
+ *  item simply runs inside Wait(). */
+class CWorkQueue
+{
+private:
+  boost::mutex mutex;
+  boost::condition_variable condWork;
+  boost::condition_variable condDone;
+  std::deque<CWorkItem*> queue;
+  const char *pszName;
+  int nThreads;
+  int nThreadsRunning;
+  bool fStop;
+
+  //pops and runs the front item, mutex held on entry and exit
+  void RunFront(boost::unique_lock<boost::mutex> &lock);
+  static void ThreadWorker(void *parg);
+
+public:
+  explicit CWorkQueue(const char *pszNameIn)
+    : pszName(pszNameIn), nThreads(0), nThreadsRunning(0), fStop(false) {}
+
+  //starts up to nThreadsIn threads, returns how many are running
+  int Start(int nThreadsIn);
+
+  //lets the running items finish and waits for the threads to exit,
+  // items still queued are left for Wait() to run
+  void Stop();
+
+  int GetThreads() const { return nThreads; }
+
+  //queues the item, it must stay alive until Wait() on it returns
+  void Push(CWorkItem *pitem);
+
+  //blocks until pitem has run, running queued items in the meantime
+  void Wait(CWorkItem *pitem);
+};
+
+#endif